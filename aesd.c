@@ -0,0 +1,618 @@
+/**
+ *  Salil Luley - D23124871
+ * A local encryption daemon. It keeps expanded keys for its clients and runs
+ * their requests, batched across clients, through the multi-block engine.
+ *
+ * Usage: ./aesd [socket path]
+ * Without a path it listens on $XDG_RUNTIME_DIR/aesd.sock, or on
+ * /run/aesd/aesd.sock when that is not set.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aesd.h"
+#include "aeshash.h"
+
+#define AESD_MAX_CLIENTS 1024
+#define AESD_MAX_KEYS_PER_CLIENT 256
+#define AESD_KEY_BUCKETS 256
+#define AESD_INBUF_REQUESTS 64
+
+/**
+ * The most requests taken into one batch. Anything beyond stays in the
+ * sockets until the next round.
+ */
+#define AESD_BATCH_MAX 4096
+
+/**
+ * Requests at least this long are run in place. Shorter ones are gathered
+ * into the staging buffer so the engine sees long runs of blocks.
+ */
+#define AESD_GATHER_LIMIT 4096
+#define AESD_STAGING_SIZE (256 * 1024)
+
+/**
+ * Responses waiting for a client that is slow to read them. Sockets are
+ * non-blocking, so a client that stops reading never stalls the loop: once
+ * its responses fill this buffer the daemon stops taking its requests.
+ */
+#define AESD_OUTBUF_RESPONSES (4 * AESD_INBUF_REQUESTS)
+
+/**
+ * @brief An expanded key shared by every client that registered the same key.
+ */
+struct key_entry {
+  unsigned char key[BLOCK_SIZE];
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  int refs;
+  struct key_entry *next;
+};
+
+/**
+ * @brief The daemon's view of one connected client.
+ */
+struct client {
+  int fd;
+  int ready; /* set once the hello and shared memory have been received */
+  unsigned char *shm;
+  size_t shm_size;
+  struct key_entry *keys[AESD_MAX_KEYS_PER_CLIENT];
+  int nbr_keys;
+  unsigned char inbuf[AESD_INBUF_REQUESTS * sizeof(struct aesd_request)];
+  size_t inbuf_len;
+  unsigned char outbuf[AESD_OUTBUF_RESPONSES * sizeof(struct aesd_response)];
+  size_t outbuf_len;
+  int closing;
+};
+
+/**
+ * @brief One request of the current batch.
+ */
+struct batch_entry {
+  struct client *client;
+  struct aesd_request request;
+  struct key_entry *key;
+  int status;
+};
+
+struct key_entry *key_buckets[AESD_KEY_BUCKETS];
+struct aes_hash_key bucket_hash_key;
+struct client *clients[AESD_MAX_CLIENTS];
+int nbr_clients = 0;
+struct batch_entry batch[AESD_BATCH_MAX];
+struct batch_entry *batch_order[AESD_BATCH_MAX];
+int batch_len = 0;
+unsigned char staging[AESD_STAGING_SIZE];
+unsigned long long stat_requests = 0, stat_batches = 0, stat_engine_calls = 0;
+volatile sig_atomic_t stopping = 0;
+
+void handle_signal(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+/**
+ * Finds or creates the shared key entry for a key and takes a reference.
+ *
+ * @param key The 16-byte key.
+ * @return The entry, or NULL if memory runs out.
+ */
+struct key_entry *acquire_key(unsigned char *key) {
+  unsigned long long h = aes_hash64(&bucket_hash_key, key, BLOCK_SIZE);
+  struct key_entry **bucket = &key_buckets[h % AESD_KEY_BUCKETS];
+  struct key_entry *entry;
+
+  for (entry = *bucket; entry != NULL; entry = entry->next) {
+    if (memcmp(entry->key, key, BLOCK_SIZE) == 0) {
+      entry->refs++;
+      return entry;
+    }
+  }
+  entry = (struct key_entry *)calloc(1, sizeof(*entry));
+  if (entry == NULL) return NULL;
+  memcpy(entry->key, key, BLOCK_SIZE);
+  expand_key(entry->expanded_key, key);
+  entry->refs = 1;
+  entry->next = *bucket;
+  *bucket = entry;
+  return entry;
+}
+
+/**
+ * Drops a reference to a key entry, wiping and freeing it when unused.
+ */
+void release_key(struct key_entry *entry) {
+  unsigned long long h;
+  struct key_entry **link;
+
+  if (--entry->refs > 0) return;
+  h = aes_hash64(&bucket_hash_key, entry->key, BLOCK_SIZE);
+  for (link = &key_buckets[h % AESD_KEY_BUCKETS]; *link != entry;
+       link = &(*link)->next) {
+  }
+  *link = entry->next;
+  memset(entry, 0, sizeof(*entry));
+  free(entry);
+}
+
+/**
+ * Disconnects a client and releases everything it holds.
+ */
+void drop_client(int index) {
+  struct client *client = clients[index];
+  int i;
+
+  for (i = 0; i < client->nbr_keys; i++) release_key(client->keys[i]);
+  if (client->shm != NULL) munmap(client->shm, client->shm_size);
+  close(client->fd);
+  free(client);
+  clients[index] = clients[--nbr_clients];
+}
+
+/**
+ * Receives the hello message and maps the shared memory that comes with it.
+ * The memory must be sealed against shrinking.
+ *
+ * @return 0 on success, -1 if the client should be dropped.
+ */
+int receive_hello(struct client *client) {
+  struct aesd_hello hello;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  struct stat st;
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  int shm_fd = -1, seals;
+  ssize_t n;
+
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  n = recvmsg(client->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+  // A failed recvmsg leaves the control buffer as it was, so there is no fd
+  // to look for or close.
+  if (n <= 0) return -1;
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS)
+    memcpy(&shm_fd, CMSG_DATA(cmsg), sizeof(int));
+
+  // Only a region that cannot shrink is safe to map: the size checked here
+  // must still hold when requests are served.
+  if (n != (ssize_t)sizeof(hello) || shm_fd < 0 ||
+      hello.magic != AESD_MAGIC || hello.version != AESD_VERSION ||
+      hello.shm_size == 0 || (seals = fcntl(shm_fd, F_GET_SEALS)) < 0 ||
+      (seals & F_SEAL_SHRINK) == 0 || fstat(shm_fd, &st) != 0 ||
+      (unsigned long long)st.st_size < hello.shm_size) {
+    if (shm_fd >= 0) close(shm_fd);
+    return -1;
+  }
+
+  client->shm = (unsigned char *)mmap(NULL, hello.shm_size,
+                                      PROT_READ | PROT_WRITE, MAP_SHARED,
+                                      shm_fd, 0);
+  close(shm_fd);
+  if (client->shm == MAP_FAILED) {
+    client->shm = NULL;
+    return -1;
+  }
+  client->shm_size = hello.shm_size;
+  client->ready = 1;
+  return 0;
+}
+
+/**
+ * Returns how many more responses fit into a client's output buffer, and so
+ * how many of its requests may be taken into the batch.
+ */
+size_t response_room(struct client *client) {
+  return (sizeof(client->outbuf) - client->outbuf_len) /
+         sizeof(struct aesd_response);
+}
+
+/**
+ * Returns non-zero if a client has a whole request buffered that did not fit
+ * into the last batch and room for its response.
+ */
+int has_pending(struct client *client) {
+  return client->inbuf_len >= sizeof(struct aesd_request) &&
+         response_room(client) > 0;
+}
+
+/**
+ * Returns non-zero if a request touches shared memory that an earlier request
+ * of the same client in this batch also touches. The batch groups requests by
+ * key and operation, so such a request must wait for the next round to run
+ * after the ones it overlaps.
+ *
+ * @param request The request about to be taken.
+ * @param first The client's first entry in the batch.
+ */
+int overlaps_batch(const struct aesd_request *request, int first) {
+  int i;
+
+  if (request->op == AESD_OP_REGISTER_KEY || request->len == 0) return 0;
+  for (i = first; i < batch_len; i++) {
+    const struct aesd_request *earlier = &batch[i].request;
+    if (earlier->op == AESD_OP_REGISTER_KEY || earlier->len == 0) continue;
+    // Out-of-range requests are refused later, so wrapping here is harmless.
+    if (request->offset < earlier->offset + earlier->len &&
+        earlier->offset < request->offset + request->len)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Reads whatever requests a client has sent and appends them to the batch,
+ * up to the first one that overlaps a request already taken from the client.
+ *
+ * @param client The client.
+ * @param readable Non-zero if poll reported the socket readable.
+ * @return 0 on success, -1 if the client hung up or misbehaved.
+ */
+int read_requests(struct client *client, int readable) {
+  size_t room = response_room(client);
+  size_t used = 0;
+  int first = batch_len;
+  ssize_t n;
+
+  if (readable && client->inbuf_len < sizeof(client->inbuf)) {
+    n = recv(client->fd, client->inbuf + client->inbuf_len,
+             sizeof(client->inbuf) - client->inbuf_len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) return -1;
+    if (n > 0) client->inbuf_len += (size_t)n;
+  }
+
+  while (client->inbuf_len - used >= sizeof(struct aesd_request) &&
+         batch_len < AESD_BATCH_MAX && room > 0) {
+    struct batch_entry *entry = &batch[batch_len];
+    memcpy(&entry->request, client->inbuf + used, sizeof(entry->request));
+    if (overlaps_batch(&entry->request, first)) break;
+    batch_len++;
+    entry->client = client;
+    entry->key = NULL;
+    entry->status = AESD_ERR_INVALID;
+    used += sizeof(struct aesd_request);
+    room--;
+  }
+  memmove(client->inbuf, client->inbuf + used, client->inbuf_len - used);
+  client->inbuf_len -= used;
+  return 0;
+}
+
+/**
+ * Registers keys and checks the remaining requests of the batch, resolving
+ * their key ids to key entries.
+ */
+void prepare_batch() {
+  int i;
+  for (i = 0; i < batch_len; i++) {
+    struct batch_entry *entry = &batch[i];
+    struct aesd_request *request = &entry->request;
+    struct client *client = entry->client;
+
+    if (request->op == AESD_OP_REGISTER_KEY) {
+      struct key_entry *key;
+      if (client->nbr_keys == AESD_MAX_KEYS_PER_CLIENT) {
+        entry->status = AESD_ERR_NO_MEMORY;
+      } else if ((key = acquire_key(request->key)) == NULL) {
+        entry->status = AESD_ERR_NO_MEMORY;
+      } else {
+        client->keys[client->nbr_keys] = key;
+        entry->status = client->nbr_keys++;
+      }
+      memset(request->key, 0, BLOCK_SIZE);
+    } else if (request->op == AESD_OP_ENCRYPT_BLOCKS ||
+               request->op == AESD_OP_DECRYPT_BLOCKS) {
+      if (request->key_id < 0 || request->key_id >= client->nbr_keys)
+        entry->status = AESD_ERR_NO_KEY;
+      else if (request->len % BLOCK_SIZE != 0 ||
+               request->offset > client->shm_size ||
+               request->len > client->shm_size - request->offset)
+        entry->status = AESD_ERR_INVALID;
+      else
+        entry->key = client->keys[request->key_id];
+    }
+  }
+}
+
+/**
+ * Orders batch entries by key and then by operation, so that requests that
+ * can share an engine call sit next to each other.
+ */
+int compare_entries(const void *a, const void *b) {
+  const struct batch_entry *x = *(struct batch_entry *const *)a;
+  const struct batch_entry *y = *(struct batch_entry *const *)b;
+  if (x->key != y->key) return x->key < y->key ? -1 : 1;
+  if (x->request.op != y->request.op)
+    return x->request.op < y->request.op ? -1 : 1;
+  return x < y ? -1 : (x > y);
+}
+
+/**
+ * Runs the engine over a run of blocks for one key and operation.
+ */
+void run_engine(struct key_entry *key, unsigned int op, unsigned char *data,
+                size_t len) {
+  stat_engine_calls++;
+  if (op == AESD_OP_ENCRYPT_BLOCKS)
+    aes_encrypt_blocks(data, data, len / BLOCK_SIZE, key->expanded_key);
+  else
+    aes_decrypt_blocks(data, data, len / BLOCK_SIZE, key->expanded_key);
+}
+
+/**
+ * Runs a group of small requests that share a key and operation: their
+ * payloads are gathered into the staging buffer, encrypted or decrypted in
+ * one engine call, and scattered back.
+ */
+void run_gathered(struct batch_entry **group, int count) {
+  size_t filled = 0;
+  int first = 0, i;
+
+  for (i = 0; i <= count; i++) {
+    size_t len = i < count ? group[i]->request.len : 0;
+    if (i == count || filled + len > AESD_STAGING_SIZE) {
+      size_t pos = 0;
+      int j;
+      if (filled > 0)
+        run_engine(group[first]->key, group[first]->request.op, staging,
+                   filled);
+      for (j = first; j < i; j++) {
+        struct batch_entry *entry = group[j];
+        memcpy(entry->client->shm + entry->request.offset, staging + pos,
+               entry->request.len);
+        pos += entry->request.len;
+        entry->status = AESD_OK;
+      }
+      first = i;
+      filled = 0;
+    }
+    if (i < count) {
+      memcpy(staging + filled,
+             group[i]->client->shm + group[i]->request.offset, len);
+      filled += len;
+    }
+  }
+}
+
+/**
+ * Executes the encrypt and decrypt requests of the batch, grouped by key and
+ * operation across all clients.
+ */
+void run_batch() {
+  int nbr_ordered = 0, start = 0, i;
+
+  for (i = 0; i < batch_len; i++) {
+    if (batch[i].key != NULL) batch_order[nbr_ordered++] = &batch[i];
+  }
+  qsort(batch_order, nbr_ordered, sizeof(batch_order[0]), compare_entries);
+
+  while (start < nbr_ordered) {
+    struct batch_entry **group = &batch_order[start];
+    int count = 0, small = 0;
+
+    while (start + count < nbr_ordered &&
+           group[count]->key == group[0]->key &&
+           group[count]->request.op == group[0]->request.op)
+      count++;
+
+    for (i = 0; i < count; i++) {
+      struct batch_entry *entry = group[i];
+      if (entry->request.len >= AESD_GATHER_LIMIT) {
+        run_engine(entry->key, entry->request.op,
+                   entry->client->shm + entry->request.offset,
+                   entry->request.len);
+        entry->status = AESD_OK;
+      } else {
+        group[small++] = entry;
+      }
+    }
+    run_gathered(group, small);
+    start += count;
+  }
+}
+
+/**
+ * Sends as much of a client's buffered responses as its socket takes without
+ * blocking. The rest waits for the socket to become writable.
+ */
+void flush_responses(struct client *client) {
+  ssize_t n;
+
+  if (client->outbuf_len == 0) return;
+  n = send(client->fd, client->outbuf, client->outbuf_len,
+           MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EINTR) client->closing = 1;
+    return;
+  }
+  memmove(client->outbuf, client->outbuf + n, client->outbuf_len - (size_t)n);
+  client->outbuf_len -= (size_t)n;
+}
+
+/**
+ * Queues the responses to the batch in one pass and sends them with one send
+ * per client. read_requests appends each client's requests together and in
+ * arrival order, so a client's responses are complete, and in order, when
+ * the next entry belongs to someone else. It also only took as many requests
+ * as there is room for responses.
+ */
+void send_responses() {
+  int i;
+
+  for (i = 0; i < batch_len; i++) {
+    struct client *client = batch[i].client;
+    struct aesd_response response;
+
+    response.id = batch[i].request.id;
+    response.status = batch[i].status;
+    response.reserved = 0;
+    memcpy(client->outbuf + client->outbuf_len, &response, sizeof(response));
+    client->outbuf_len += sizeof(response);
+    if (i + 1 == batch_len || batch[i + 1].client != client)
+      flush_responses(client);
+  }
+}
+
+/**
+ * Accepts a pending connection, if there is room for it.
+ */
+void accept_client(int listen_fd) {
+  struct client *client;
+  int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+  if (fd < 0) return;
+  if (nbr_clients == AESD_MAX_CLIENTS ||
+      (client = (struct client *)calloc(1, sizeof(*client))) == NULL) {
+    close(fd);
+    return;
+  }
+  client->fd = fd;
+  clients[nbr_clients++] = client;
+}
+
+/**
+ * Creates the listening socket with mode AESD_SOCKET_MODE. It is bound under
+ * a umask that leaves it private, so it is never reachable by others before
+ * its mode is set.
+ *
+ * @return The socket, or -1 on error.
+ */
+int listen_on(const char *path) {
+  struct sockaddr_un addr;
+  mode_t old_mask;
+  int fd, bound;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  old_mask = umask(0077);
+  bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (bound != 0 || chmod(path, AESD_SOCKET_MODE) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Entry point of the daemon.
+ * @return 0 after a clean shutdown, 1 on a setup error.
+ */
+int main(int argc, char **argv) {
+  static struct pollfd fds[AESD_MAX_CLIENTS + 1];
+  char default_path[256];
+  const char *path = argc > 1 ? argv[1] : default_path;
+  unsigned char hash_seed[BLOCK_SIZE];
+  struct sigaction action;
+  int listen_fd, urandom, i;
+
+  urandom = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  if (urandom < 0 || read(urandom, hash_seed, sizeof(hash_seed)) !=
+                         (ssize_t)sizeof(hash_seed)) {
+    fprintf(stderr, "aesd: cannot read /dev/urandom\n");
+    return 1;
+  }
+  close(urandom);
+  aes_hash_init(&bucket_hash_key, hash_seed);
+
+  if (argc < 2 &&
+      aesd_default_socket(default_path, sizeof(default_path)) != 0) {
+    fprintf(stderr, "aesd: $XDG_RUNTIME_DIR is too long\n");
+    return 1;
+  }
+
+  listen_fd = listen_on(path);
+  if (listen_fd < 0) {
+    fprintf(stderr, "aesd: cannot listen on %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  while (!stopping) {
+    int nbr_fds = nbr_clients;
+    int timeout = -1;
+
+    for (i = 0; i < nbr_clients; i++) {
+      fds[i].fd = clients[i]->fd;
+      fds[i].events = response_room(clients[i]) > 0 ? POLLIN : 0;
+      if (clients[i]->outbuf_len > 0) fds[i].events |= POLLOUT;
+      fds[i].revents = 0;
+      if (has_pending(clients[i])) timeout = 0;
+    }
+    fds[nbr_fds].fd = listen_fd;
+    fds[nbr_fds].events = POLLIN;
+    fds[nbr_fds].revents = 0;
+    if (poll(fds, nbr_fds + 1, timeout) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    // Everything readable now goes into one batch.
+    batch_len = 0;
+    for (i = 0; i < nbr_fds; i++) {
+      struct client *client = clients[i];
+      int readable = (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+      if (fds[i].revents & POLLOUT) flush_responses(client);
+      if (!readable && !has_pending(client)) continue;
+      if (!client->ready ? receive_hello(client) != 0
+                         : read_requests(client, readable) != 0)
+        client->closing = 1;
+    }
+
+    if (batch_len > 0) {
+      stat_batches++;
+      stat_requests += batch_len;
+      prepare_batch();
+      run_batch();
+      send_responses();
+    }
+
+    for (i = nbr_clients - 1; i >= 0; i--) {
+      if (clients[i]->closing) drop_client(i);
+    }
+    if (fds[nbr_fds].revents & POLLIN) accept_client(listen_fd);
+  }
+
+  while (nbr_clients > 0) drop_client(nbr_clients - 1);
+  close(listen_fd);
+  unlink(path);
+  fprintf(stderr,
+          "aesd: %llu requests in %llu batches, %llu engine calls\n",
+          stat_requests, stat_batches, stat_engine_calls);
+  return 0;
+}
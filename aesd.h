@@ -0,0 +1,98 @@
+/*
+ * Salil Luley - D23124871
+ * This file, aesd.h, describes the local encryption daemon (aesd.c) and the
+ * client functions that talk to it (aesd_client.c). The daemon holds expanded
+ * keys for many short-lived processes, so they do not each rebuild them. It
+ * listens on a Unix domain socket. Each client shares a memory region with
+ * the daemon, passed once as a file descriptor, so payloads are never copied
+ * through the socket. Requests that arrive together from different clients
+ * under the same key are run as one batch through the multi-block engine.
+ *
+ * Protocol (all integers in host byte order, since both ends are local):
+ *
+ *   hello     struct aesd_hello, sent with the shared memory fd attached;
+ *             the fd must be a memfd sealed with at least F_SEAL_SHRINK
+ *   request   struct aesd_request
+ *   response  struct aesd_response, one per request, in request order
+ */
+
+#ifndef AESD_H
+#define AESD_H
+
+#include <stddef.h>
+
+#include "rijndael.h"
+
+/*
+ * The socket lives in a runtime directory that only its owner can write to,
+ * so no other user can bind the path first: $XDG_RUNTIME_DIR/aesd.sock when
+ * that is set, and otherwise AESD_SYSTEM_SOCKET in a directory made by root.
+ * The socket itself is created with mode AESD_SOCKET_MODE, and clients only
+ * talk to a daemon running as their own user or as root.
+ */
+#define AESD_SOCKET_NAME "aesd.sock"
+#define AESD_SYSTEM_SOCKET "/run/aesd/aesd.sock"
+#define AESD_SOCKET_MODE 0660
+#define AESD_MAGIC 0x41455344u /* "AESD" */
+#define AESD_VERSION 1
+
+/* Request operations */
+#define AESD_OP_REGISTER_KEY 1
+#define AESD_OP_ENCRYPT_BLOCKS 2
+#define AESD_OP_DECRYPT_BLOCKS 3
+
+/* Status values other than key ids */
+#define AESD_OK 0
+#define AESD_ERR_INVALID -1
+#define AESD_ERR_NO_KEY -2
+#define AESD_ERR_NO_MEMORY -3
+
+struct aesd_hello {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long shm_size;
+};
+
+struct aesd_request {
+  unsigned int op;
+  int key_id;
+  unsigned long long id;
+  unsigned long long offset; /* into the shared memory */
+  unsigned long long len;    /* a multiple of BLOCK_SIZE */
+  unsigned char key[BLOCK_SIZE]; /* AESD_OP_REGISTER_KEY only */
+};
+
+struct aesd_response {
+  unsigned long long id;
+  int status; /* AESD_OK, an error, or the new key id */
+  unsigned int reserved;
+};
+
+struct aesd_conn;
+
+/*
+ * Writes the default socket path into path. Returns 0, or -1 if it does not
+ * fit into size bytes.
+ */
+int aesd_default_socket(char *path, size_t size);
+/*
+ * Connects to the daemon at path, or at the default socket if path is NULL,
+ * and shares a new memory region of shm_size bytes with it. Returns NULL on
+ * error, or if the daemon runs as neither this user nor root.
+ */
+struct aesd_conn *aesd_connect(const char *path, size_t shm_size);
+/* The shared memory region. Payloads are placed here and processed in place. */
+unsigned char *aesd_buffer(struct aesd_conn *conn);
+/* Returns a key id for this connection, or a negative status. */
+int aesd_register_key(struct aesd_conn *conn, unsigned char *key);
+/*
+ * Encrypt or decrypt len bytes at offset in the shared memory in place, and
+ * wait for the result. Return AESD_OK or a negative status.
+ */
+int aesd_encrypt_blocks(struct aesd_conn *conn, int key_id, size_t offset,
+                        size_t len);
+int aesd_decrypt_blocks(struct aesd_conn *conn, int key_id, size_t offset,
+                        size_t len);
+void aesd_close(struct aesd_conn *conn);
+
+#endif
@@ -0,0 +1,205 @@
+// Salil Luley - D23124871
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aesd.h"
+#include "rijndael.h"
+
+/**
+ * @file aesd_bench.c
+ * @brief Compares the encryption daemon with in-process calls under many
+ * concurrent clients, reporting throughput and tail latency.
+ *
+ * Usage: ./aesd_bench [clients] [request bytes] [requests per client]
+ * The daemon binary ./aesd is started on a private socket for the run.
+ */
+
+/**
+ * @brief The modes a client thread can run in.
+ */
+enum bench_mode { MODE_DAEMON, MODE_IN_PROCESS_EXPAND, MODE_IN_PROCESS_CACHED };
+
+/**
+ * @brief The work and results of one client thread.
+ */
+struct client_run {
+  enum bench_mode mode;
+  const char *socket_path;
+  size_t request_len;
+  int nbr_requests;
+  double *latencies;
+  int failed;
+};
+
+unsigned char bench_key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                               75, 17, 51, 17, 4,  8, 6,  99};
+
+/**
+ * Returns a monotonic timestamp in seconds.
+ */
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Thread body of one client. In daemon mode it connects, registers the key
+ * and sends its requests one at a time. In the in-process modes it calls the
+ * engine directly, either expanding the key for every request (as a
+ * short-lived process would) or once up front.
+ */
+void *client_thread(void *arg) {
+  struct client_run *run = (struct client_run *)arg;
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  struct aesd_conn *conn = NULL;
+  unsigned char *buffer;
+  int key_id = 0, i;
+
+  if (run->mode == MODE_DAEMON) {
+    conn = aesd_connect(run->socket_path, run->request_len);
+    if (conn == NULL || (key_id = aesd_register_key(conn, bench_key)) < 0) {
+      run->failed = 1;
+      aesd_close(conn);
+      return NULL;
+    }
+    buffer = aesd_buffer(conn);
+  } else {
+    buffer = (unsigned char *)malloc(run->request_len);
+    expand_key(expanded_key, bench_key);
+  }
+  memset(buffer, 0x5a, run->request_len);
+
+  for (i = 0; i < run->nbr_requests; i++) {
+    double start = now_seconds();
+    if (run->mode == MODE_DAEMON) {
+      if (aesd_encrypt_blocks(conn, key_id, 0, run->request_len) != AESD_OK)
+        run->failed = 1;
+    } else {
+      if (run->mode == MODE_IN_PROCESS_EXPAND)
+        expand_key(expanded_key, bench_key);
+      aes_encrypt_blocks(buffer, buffer, run->request_len / BLOCK_SIZE,
+                         expanded_key);
+    }
+    run->latencies[i] = now_seconds() - start;
+  }
+
+  if (conn != NULL)
+    aesd_close(conn);
+  else
+    free(buffer);
+  return NULL;
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Runs every client of one mode concurrently and prints the results.
+ */
+void run_mode(const char *name, enum bench_mode mode, const char *socket_path,
+              int nbr_clients, size_t request_len, int nbr_requests) {
+  struct client_run *runs = calloc(nbr_clients, sizeof(*runs));
+  pthread_t *threads = calloc(nbr_clients, sizeof(*threads));
+  size_t total = (size_t)nbr_clients * nbr_requests;
+  double *all = malloc(total * sizeof(double));
+  double start, elapsed;
+  int i, failed = 0;
+
+  start = now_seconds();
+  for (i = 0; i < nbr_clients; i++) {
+    runs[i].mode = mode;
+    runs[i].socket_path = socket_path;
+    runs[i].request_len = request_len;
+    runs[i].nbr_requests = nbr_requests;
+    runs[i].latencies = all + (size_t)i * nbr_requests;
+    pthread_create(&threads[i], NULL, client_thread, &runs[i]);
+  }
+  for (i = 0; i < nbr_clients; i++) {
+    pthread_join(threads[i], NULL);
+    failed |= runs[i].failed;
+  }
+  elapsed = now_seconds() - start;
+
+  qsort(all, total, sizeof(double), compare_doubles);
+  printf("%-22s %9.2f MB/s  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us%s\n",
+         name, (double)total * request_len / elapsed / 1e6,
+         all[total / 2] * 1e6, all[total * 99 / 100] * 1e6,
+         all[total * 999 / 1000] * 1e6, failed ? "  (errors)" : "");
+
+  free(all);
+  free(threads);
+  free(runs);
+}
+
+/**
+ * Starts ./aesd on the given socket and waits until it accepts connections.
+ *
+ * @return The daemon's process id, or -1 if it did not come up.
+ */
+pid_t start_daemon(const char *socket_path) {
+  pid_t pid = fork();
+  int i;
+
+  if (pid == 0) {
+    execl("./aesd", "aesd", socket_path, (char *)NULL);
+    _exit(127);
+  }
+  for (i = 0; pid > 0 && i < 100; i++) {
+    struct aesd_conn *conn = aesd_connect(socket_path, BLOCK_SIZE);
+    if (conn != NULL) {
+      aesd_close(conn);
+      return pid;
+    }
+    usleep(20000);
+  }
+  if (pid > 0) kill(pid, SIGTERM);
+  return -1;
+}
+
+/**
+ * @brief Entry point of the benchmark.
+ * @return 0 on success, 1 if the daemon could not be started.
+ */
+int main(int argc, char **argv) {
+  int nbr_clients = argc > 1 ? atoi(argv[1]) : 32;
+  size_t request_len = argc > 2 ? (size_t)atol(argv[2]) : 64;
+  int nbr_requests = argc > 3 ? atoi(argv[3]) : 200;
+  char socket_path[64];
+  pid_t daemon;
+
+  if (nbr_clients < 1) nbr_clients = 1;
+  if (nbr_requests < 1) nbr_requests = 1;
+  request_len = (request_len + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+  if (request_len == 0) request_len = BLOCK_SIZE;
+
+  snprintf(socket_path, sizeof(socket_path), "/tmp/aesd-bench-%d.sock",
+           (int)getpid());
+  daemon = start_daemon(socket_path);
+  if (daemon < 0) {
+    fprintf(stderr, "aesd_bench: could not start ./aesd\n");
+    return 1;
+  }
+
+  printf("%d clients, %zu-byte requests, %d requests each\n", nbr_clients,
+         request_len, nbr_requests);
+  run_mode("daemon", MODE_DAEMON, socket_path, nbr_clients, request_len,
+           nbr_requests);
+  run_mode("in-process, expand", MODE_IN_PROCESS_EXPAND, NULL, nbr_clients,
+           request_len, nbr_requests);
+  run_mode("in-process, cached", MODE_IN_PROCESS_CACHED, NULL, nbr_clients,
+           request_len, nbr_requests);
+
+  kill(daemon, SIGTERM);
+  waitpid(daemon, NULL, 0);
+  return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ *  Salil Luley - D23124871
+ * Client side of the local encryption daemon: connects over a Unix socket,
+ * shares a memory region and sends requests that refer into it.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aesd.h"
+
+struct aesd_conn {
+  int fd;
+  unsigned char *shm;
+  size_t shm_size;
+  unsigned long long next_id;
+};
+
+/**
+ * Sends or receives a whole buffer over the socket, retrying on short
+ * transfers and interrupts.
+ *
+ * @return 0 on success, -1 on error or end of stream.
+ */
+static int transfer_full(int fd, void *data, size_t len, int sending) {
+  unsigned char *p = (unsigned char *)data;
+  while (len > 0) {
+    ssize_t n = sending ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/**
+ * Builds the default socket path: $XDG_RUNTIME_DIR/aesd.sock, or
+ * AESD_SYSTEM_SOCKET when there is no per-user runtime directory.
+ *
+ * @param path Where the path is written.
+ * @param size The size of path in bytes.
+ * @return 0 on success, -1 if the path does not fit.
+ */
+int aesd_default_socket(char *path, size_t size) {
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  int n;
+
+  if (dir != NULL && dir[0] == '/')
+    n = snprintf(path, size, "%s/%s", dir, AESD_SOCKET_NAME);
+  else
+    n = snprintf(path, size, "%s", AESD_SYSTEM_SOCKET);
+  return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+/**
+ * Returns non-zero if the process at the other end of a socket runs as this
+ * user or as root. Keys are sent to the daemon in the clear, so they must
+ * not go to whoever managed to bind the socket path.
+ */
+static int trusted_peer(int fd) {
+  struct ucred peer;
+  socklen_t len = sizeof(peer);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) != 0 ||
+      len != sizeof(peer))
+    return 0;
+  return peer.uid == geteuid() || peer.uid == 0;
+}
+
+/**
+ * Connects to the daemon, checks who it runs as, creates the shared memory
+ * region and hands its file descriptor over with the hello message.
+ *
+ * @param path The socket path, or NULL for the default socket.
+ * @param shm_size The size of the shared memory region in bytes.
+ * @return The connection, or NULL on error.
+ */
+struct aesd_conn *aesd_connect(const char *path, size_t shm_size) {
+  struct aesd_conn *conn;
+  struct sockaddr_un addr;
+  struct aesd_hello hello;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  char default_path[sizeof(addr.sun_path)];
+  int shm_fd = -1;
+
+  if (path == NULL) {
+    if (aesd_default_socket(default_path, sizeof(default_path)) != 0)
+      return NULL;
+    path = default_path;
+  }
+  if (strlen(path) >= sizeof(addr.sun_path) || shm_size == 0) return NULL;
+
+  conn = (struct aesd_conn *)calloc(1, sizeof(*conn));
+  if (conn == NULL) return NULL;
+  conn->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  conn->shm = MAP_FAILED;
+  conn->shm_size = shm_size;
+  if (conn->fd < 0) goto fail;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      !trusted_peer(conn->fd))
+    goto fail;
+
+  // The daemon maps the region too, so its size is sealed: a shrink would
+  // turn the daemon's accesses into SIGBUS.
+  shm_fd = memfd_create("aesd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (shm_fd < 0 || ftruncate(shm_fd, (off_t)shm_size) != 0 ||
+      fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) !=
+          0)
+    goto fail;
+  conn->shm = (unsigned char *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, shm_fd, 0);
+  if (conn->shm == MAP_FAILED) goto fail;
+
+  hello.magic = AESD_MAGIC;
+  hello.version = AESD_VERSION;
+  hello.shm_size = shm_size;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+  if (sendmsg(conn->fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello))
+    goto fail;
+
+  close(shm_fd);
+  return conn;
+
+fail:
+  if (shm_fd >= 0) close(shm_fd);
+  aesd_close(conn);
+  return NULL;
+}
+
+/**
+ * Returns the shared memory region of a connection.
+ */
+unsigned char *aesd_buffer(struct aesd_conn *conn) { return conn->shm; }
+
+/**
+ * Sends one request and waits for its response.
+ *
+ * @return The status from the response, or AESD_ERR_INVALID if the
+ * connection failed.
+ */
+static int aesd_call(struct aesd_conn *conn, struct aesd_request *request) {
+  struct aesd_response response;
+
+  request->id = conn->next_id++;
+  if (transfer_full(conn->fd, request, sizeof(*request), 1) != 0 ||
+      transfer_full(conn->fd, &response, sizeof(response), 0) != 0 ||
+      response.id != request->id)
+    return AESD_ERR_INVALID;
+  return response.status;
+}
+
+/**
+ * Registers a key with the daemon for this connection.
+ *
+ * @param conn The connection.
+ * @param key The 16-byte key.
+ * @return The key id, or a negative status.
+ */
+int aesd_register_key(struct aesd_conn *conn, unsigned char *key) {
+  struct aesd_request request;
+  int status;
+
+  memset(&request, 0, sizeof(request));
+  request.op = AESD_OP_REGISTER_KEY;
+  memcpy(request.key, key, BLOCK_SIZE);
+  status = aesd_call(conn, &request);
+  memset(request.key, 0, BLOCK_SIZE);
+  return status;
+}
+
+/**
+ * Sends an encrypt or decrypt request for a range of the shared memory.
+ */
+static int aesd_blocks(struct aesd_conn *conn, unsigned int op, int key_id,
+                       size_t offset, size_t len) {
+  struct aesd_request request;
+
+  memset(&request, 0, sizeof(request));
+  request.op = op;
+  request.key_id = key_id;
+  request.offset = offset;
+  request.len = len;
+  return aesd_call(conn, &request);
+}
+
+/**
+ * Encrypts len bytes at offset in the shared memory in place.
+ *
+ * @return AESD_OK or a negative status.
+ */
+int aesd_encrypt_blocks(struct aesd_conn *conn, int key_id, size_t offset,
+                        size_t len) {
+  return aesd_blocks(conn, AESD_OP_ENCRYPT_BLOCKS, key_id, offset, len);
+}
+
+/**
+ * Decrypts len bytes at offset in the shared memory in place.
+ *
+ * @return AESD_OK or a negative status.
+ */
+int aesd_decrypt_blocks(struct aesd_conn *conn, int key_id, size_t offset,
+                        size_t len) {
+  return aesd_blocks(conn, AESD_OP_DECRYPT_BLOCKS, key_id, offset, len);
+}
+
+/**
+ * Closes the connection and unmaps the shared memory.
+ */
+void aesd_close(struct aesd_conn *conn) {
+  if (conn == NULL) return;
+  if (conn->fd >= 0) close(conn->fd);
+  if (conn->shm != MAP_FAILED) munmap(conn->shm, conn->shm_size);
+  free(conn);
+}
@@ -0,0 +1,252 @@
+/**
+ *  Salil Luley - D23124871
+ * A keyed hash for hash tables built from AES rounds, with an AESENC path
+ * chosen at run time on processors that have AES-NI.
+ */
+
+#include "aeshash.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <wmmintrin.h>
+#define AES_HASH_HAVE_AESNI 1
+#endif
+
+/**
+ * Which implementation aes_hash128 uses: 1 for AES-NI, 0 for the portable
+ * rounds, -1 until the processor has been checked.
+ */
+static int aes_hash_aesni = -1;
+
+/**
+ * Writes a length as eight little-endian bytes at the start of a zeroed block.
+ *
+ * @param block The 16-byte block to fill.
+ * @param len The length to encode.
+ */
+static void length_block(unsigned char *block, size_t len) {
+  unsigned long long value = (unsigned long long)len;
+  int i;
+  memset(block, 0, BLOCK_SIZE);
+  for (i = 0; i < 8; i++) block[i] = (unsigned char)(value >> (8 * i));
+}
+
+/**
+ * Derives the two lane keys from a 16-byte key by encrypting two constant
+ * blocks. This costs one key expansion per key, not per hash.
+ *
+ * @param hkey The hash key to fill in.
+ * @param key The 16-byte secret key.
+ */
+void aes_hash_init(struct aes_hash_key *hkey, unsigned char *key) {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char blocks[2 * BLOCK_SIZE] = {0};
+
+  blocks[BLOCK_SIZE - 1] = 0x01;
+  blocks[2 * BLOCK_SIZE - 1] = 0x02;
+  expand_key(expanded_key, key);
+  aes_encrypt_blocks(blocks, blocks, 2, expanded_key);
+  memcpy(hkey->k0, blocks, BLOCK_SIZE);
+  memcpy(hkey->k1, blocks + BLOCK_SIZE, BLOCK_SIZE);
+}
+
+#ifdef AES_HASH_HAVE_AESNI
+
+/**
+ * Computes the 128-bit hash with the AESENC instruction. It is compiled for
+ * AES-NI whatever the flags of the rest of the library, and only called once
+ * the processor is known to support it.
+ *
+ * @param hkey The hash key.
+ * @param data The input.
+ * @param len The length of the input in bytes.
+ * @param out Where the 16-byte hash is written.
+ */
+__attribute__((target("aes,sse2"))) static void aes_hash128_aesni(
+    struct aes_hash_key *hkey, const unsigned char *data, size_t len,
+    unsigned char *out) {
+  unsigned char tail[BLOCK_SIZE];
+  __m128i k0 = _mm_loadu_si128((const __m128i *)hkey->k0);
+  __m128i k1 = _mm_loadu_si128((const __m128i *)hkey->k1);
+  __m128i s0, s1, m, f;
+  size_t full = len / BLOCK_SIZE;
+  size_t rem = len % BLOCK_SIZE;
+  size_t i;
+
+  length_block(tail, len);
+  s0 = _mm_xor_si128(k0, _mm_loadu_si128((const __m128i *)tail));
+  s1 = k1;
+  for (i = 0; i < full; i++) {
+    m = _mm_loadu_si128((const __m128i *)(data + i * BLOCK_SIZE));
+    s0 = _mm_aesenc_si128(_mm_aesenc_si128(_mm_xor_si128(s0, m), k0), k1);
+    s1 = _mm_aesenc_si128(_mm_aesenc_si128(s1, m), k0);
+  }
+  if (rem > 0) {
+    memset(tail, 0, BLOCK_SIZE);
+    memcpy(tail, data + full * BLOCK_SIZE, rem);
+    m = _mm_loadu_si128((const __m128i *)tail);
+    s0 = _mm_aesenc_si128(_mm_aesenc_si128(_mm_xor_si128(s0, m), k0), k1);
+    s1 = _mm_aesenc_si128(_mm_aesenc_si128(s1, m), k0);
+  }
+
+  f = _mm_aesenc_si128(s0, s1);
+  f = _mm_aesenc_si128(f, k1);
+  f = _mm_aesenc_si128(f, k0);
+  f = _mm_aesenc_si128(f, k1);
+  _mm_storeu_si128((__m128i *)out, f);
+}
+
+#endif
+
+/**
+ * Copies a block between byte order and the column-major state order used by
+ * the round functions in rijndael.c. The copy is its own inverse.
+ *
+ * @param dst The destination block.
+ * @param src The source block.
+ */
+static void transpose_state(unsigned char *dst, const unsigned char *src) {
+  int i, j;
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) dst[(i + (j * 4))] = src[(i * 4) + j];
+  }
+}
+
+/**
+ * One AES encryption round on a state in column-major order, the same
+ * operation as AESENC.
+ *
+ * @param state The state to transform.
+ * @param round_key The round key, also in column-major order.
+ */
+static void aes_round(unsigned char *state, unsigned char *round_key) {
+  sub_bytes(state);
+  shift_rows(state);
+  mix_columns(state);
+  add_round_key(state, round_key);
+}
+
+/**
+ * Absorbs one block into both lanes with two rounds each, so a difference in
+ * the block has spread over the whole state of both lanes before the next
+ * block can try to cancel it.
+ *
+ * @param s0 The first lane.
+ * @param s1 The second lane.
+ * @param m The block, in column-major order.
+ * @param k0 The first lane key, in column-major order.
+ * @param k1 The second lane key, in column-major order.
+ */
+static void absorb(unsigned char *s0, unsigned char *s1, unsigned char *m,
+                   unsigned char *k0, unsigned char *k1) {
+  add_round_key(s0, m);
+  aes_round(s0, k0);
+  aes_round(s0, k1);
+  aes_round(s1, m);
+  aes_round(s1, k0);
+}
+
+/**
+ * Computes the 128-bit hash with the table-based round functions.
+ *
+ * @param hkey The hash key.
+ * @param data The input.
+ * @param len The length of the input in bytes.
+ * @param out Where the 16-byte hash is written.
+ */
+static void aes_hash128_portable(struct aes_hash_key *hkey,
+                                 const unsigned char *data, size_t len,
+                                 unsigned char *out) {
+  unsigned char k0[BLOCK_SIZE], k1[BLOCK_SIZE];
+  unsigned char s0[BLOCK_SIZE], s1[BLOCK_SIZE];
+  unsigned char m[BLOCK_SIZE], tail[BLOCK_SIZE];
+  size_t full = len / BLOCK_SIZE;
+  size_t rem = len % BLOCK_SIZE;
+  size_t i;
+
+  transpose_state(k0, hkey->k0);
+  transpose_state(k1, hkey->k1);
+  length_block(tail, len);
+  transpose_state(s0, tail);
+  add_round_key(s0, k0);
+  memcpy(s1, k1, BLOCK_SIZE);
+
+  for (i = 0; i < full; i++) {
+    transpose_state(m, data + i * BLOCK_SIZE);
+    absorb(s0, s1, m, k0, k1);
+  }
+  if (rem > 0) {
+    memset(tail, 0, BLOCK_SIZE);
+    memcpy(tail, data + full * BLOCK_SIZE, rem);
+    transpose_state(m, tail);
+    absorb(s0, s1, m, k0, k1);
+  }
+
+  aes_round(s0, s1);
+  aes_round(s0, k1);
+  aes_round(s0, k0);
+  aes_round(s0, k1);
+  transpose_state(out, s0);
+}
+
+/**
+ * Chooses the implementation of aes_hash128.
+ *
+ * @param allow_aesni Non-zero to use AES-NI when the processor has it, zero
+ * to force the portable rounds.
+ * @return Non-zero if AES-NI is now in use.
+ */
+int aes_hash_select(int allow_aesni) {
+  int aesni = 0;
+#ifdef AES_HASH_HAVE_AESNI
+  __builtin_cpu_init();
+  aesni = allow_aesni && __builtin_cpu_supports("aes") &&
+          __builtin_cpu_supports("sse2");
+#else
+  (void)allow_aesni;
+#endif
+  __atomic_store_n(&aes_hash_aesni, aesni, __ATOMIC_RELAXED);
+  return aesni;
+}
+
+/**
+ * Computes the 128-bit hash, with AES-NI if the processor has it.
+ *
+ * @param hkey The hash key.
+ * @param data The input.
+ * @param len The length of the input in bytes.
+ * @param out Where the 16-byte hash is written.
+ */
+void aes_hash128(struct aes_hash_key *hkey, const unsigned char *data,
+                 size_t len, unsigned char *out) {
+  int aesni = __atomic_load_n(&aes_hash_aesni, __ATOMIC_RELAXED);
+  if (aesni < 0) aesni = aes_hash_select(1);
+#ifdef AES_HASH_HAVE_AESNI
+  if (aesni) {
+    aes_hash128_aesni(hkey, data, len, out);
+    return;
+  }
+#endif
+  aes_hash128_portable(hkey, data, len, out);
+}
+
+/**
+ * Computes the 64-bit hash by folding the two halves of the 128-bit hash.
+ *
+ * @param hkey The hash key.
+ * @param data The input.
+ * @param len The length of the input in bytes.
+ * @return The 64-bit hash.
+ */
+unsigned long long aes_hash64(struct aes_hash_key *hkey,
+                              const unsigned char *data, size_t len) {
+  unsigned char out[AES_HASH128_SIZE];
+  unsigned long long value = 0;
+  int i;
+
+  aes_hash128(hkey, data, len, out);
+  for (i = 0; i < 8; i++)
+    value |= (unsigned long long)(out[i] ^ out[i + 8]) << (8 * i);
+  return value;
+}
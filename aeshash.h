@@ -0,0 +1,43 @@
+/*
+ * Salil Luley - D23124871
+ * This file, aeshash.h, declares a keyed, non-cryptographic hash built from
+ * AES rounds, meant for in-memory hash tables that must resist hash-flooding.
+ * It is not a MAC: use OCB (ocb.h) when integrity matters.
+ * Every 16-byte block of input goes through two AES rounds in each of two
+ * independent lanes: one round alone lets a difference in one block be
+ * cancelled in both lanes by the next block. The lanes are combined by four
+ * more rounds at the end.
+ * On processors with AES-NI the rounds use the AESENC instruction, chosen at
+ * run time; otherwise they use sub_bytes, shift_rows, mix_columns and
+ * add_round_key from rijndael.c. Both give the same hash values.
+ */
+
+#ifndef AESHASH_H
+#define AESHASH_H
+
+#include <stddef.h>
+
+#include "rijndael.h"
+
+#define AES_HASH128_SIZE 16
+
+struct aes_hash_key {
+  unsigned char k0[BLOCK_SIZE];
+  unsigned char k1[BLOCK_SIZE];
+};
+
+void aes_hash_init(struct aes_hash_key *hkey, unsigned char *key);
+void aes_hash128(struct aes_hash_key *hkey, const unsigned char *data,
+                 size_t len, unsigned char *out);
+unsigned long long aes_hash64(struct aes_hash_key *hkey,
+                              const unsigned char *data, size_t len);
+
+/*
+ * Uses AES-NI when allow_aesni is non-zero and the processor has it, or
+ * forces the portable rounds. Returns non-zero if AES-NI is in use. Hashing
+ * picks AES-NI automatically; this is for tests and benchmarks, and should
+ * not be called while other threads are hashing.
+ */
+int aes_hash_select(int allow_aesni);
+
+#endif
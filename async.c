@@ -0,0 +1,458 @@
+/**
+ *  Salil Luley - D23124871
+ * Asynchronous job queue: a bounded submission queue served in batches by
+ * worker threads, and a completion queue signalled through an eventfd.
+ */
+
+#include "async.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ctr.h"
+#include "gcm.h"
+#include "ocb.h"
+
+#define AES_ASYNC_MAX_WORKERS 64
+
+struct aes_async {
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;  /* a job was submitted, or stopping */
+  pthread_cond_t space_ready; /* in_flight dropped below capacity */
+  pthread_cond_t done_ready;  /* a job was posted to the completion queue */
+  struct aes_job **submitted;
+  unsigned int submitted_head;
+  unsigned int submitted_count;
+  struct aes_job **completed;
+  unsigned int completed_head;
+  unsigned int completed_count;
+  unsigned int capacity;
+  unsigned int batch_size;
+  unsigned int in_flight; /* submitted and not yet reaped */
+  int stopping;
+  int nbr_workers;
+  pthread_t workers[AES_ASYNC_MAX_WORKERS];
+  int event_fd;
+  struct aes_async_stats stats;
+};
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+static unsigned long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/**
+ * Checks a job's lengths against its mode before it runs, so that a bad
+ * argument is never read past the end of iv or reported as a failed tag.
+ *
+ * @return Non-zero if the job may run.
+ */
+static int job_is_valid(const struct aes_job *job) {
+  switch (job->mode) {
+    case AES_JOB_ECB_ENCRYPT:
+    case AES_JOB_ECB_DECRYPT:
+      return job->len % BLOCK_SIZE == 0;
+    case AES_JOB_CTR:
+      return 1;
+    case AES_JOB_GCM_ENCRYPT:
+    case AES_JOB_GCM_DECRYPT:
+      return job->iv_len > 0 && job->iv_len <= sizeof(job->iv) &&
+             (unsigned long long)job->len <= GCM_MAX_LEN;
+    case AES_JOB_OCB_ENCRYPT:
+    case AES_JOB_OCB_DECRYPT:
+      return job->iv_len <= OCB_MAX_NONCE_SIZE &&
+             ((unsigned long long)(job->len / BLOCK_SIZE) >>
+              OCB_L_TABLE_SIZE) == 0 &&
+             ((unsigned long long)(job->ad_len / BLOCK_SIZE) >>
+              OCB_L_TABLE_SIZE) == 0;
+  }
+  return 0;
+}
+
+/**
+ * Runs one job with the mode it asks for and records its status.
+ */
+static void run_job(struct aes_job *job) {
+  int result = -1;
+
+  if (!job_is_valid(job)) {
+    job->status = AES_JOB_ERR_INVALID;
+    return;
+  }
+  switch (job->mode) {
+    case AES_JOB_ECB_ENCRYPT:
+    case AES_JOB_ECB_DECRYPT:
+      if (job->mode == AES_JOB_ECB_ENCRYPT)
+        aes_encrypt_blocks(job->input, job->output, job->len / BLOCK_SIZE,
+                           (unsigned char *)job->ctx);
+      else
+        aes_decrypt_blocks(job->input, job->output, job->len / BLOCK_SIZE,
+                           (unsigned char *)job->ctx);
+      result = 0;
+      break;
+    case AES_JOB_CTR:
+      result = ctr_crypt((struct ctr_context *)job->ctx, job->iv, job->input,
+                         job->output, job->len);
+      break;
+    case AES_JOB_GCM_ENCRYPT:
+      result = gcm_encrypt((struct gcm_context *)job->ctx, job->iv,
+                           job->iv_len, job->ad, job->ad_len, job->input,
+                           job->len, job->output, job->tag);
+      break;
+    case AES_JOB_GCM_DECRYPT:
+      if (gcm_decrypt((struct gcm_context *)job->ctx, job->iv, job->iv_len,
+                      job->ad, job->ad_len, job->input, job->len, job->tag,
+                      job->output) != 0) {
+        job->status = AES_JOB_ERR_AUTH;
+        return;
+      }
+      result = 0;
+      break;
+    case AES_JOB_OCB_ENCRYPT:
+      result = ocb_encrypt((struct ocb_context *)job->ctx, job->iv,
+                           job->iv_len, job->ad, job->ad_len, job->input,
+                           job->len, job->output, job->tag);
+      break;
+    case AES_JOB_OCB_DECRYPT:
+      if (ocb_decrypt((struct ocb_context *)job->ctx, job->iv, job->iv_len,
+                      job->ad, job->ad_len, job->input, job->len, job->tag,
+                      job->output) != 0) {
+        job->status = AES_JOB_ERR_AUTH;
+        return;
+      }
+      result = 0;
+      break;
+  }
+  job->status = result == 0 ? AES_JOB_OK : AES_JOB_ERR_INVALID;
+}
+
+/**
+ * Marks the eventfd readable.
+ */
+static void signal_eventfd(struct aes_async *queue) {
+  unsigned long long one = 1;
+  ssize_t n = write(queue->event_fd, &one, sizeof(one));
+  (void)n;  // a full counter is already readable
+}
+
+/**
+ * Worker thread: takes up to batch_size jobs under one lock, runs them
+ * unlocked, then posts all their completions under one lock and with one
+ * eventfd write. A batch only saves these lock acquisitions and wakeups: its
+ * jobs still run one by one, each with its own engine call. Callbacks run
+ * last, once the job has been accounted for and released from the queue,
+ * because a callback may free or resubmit its job.
+ */
+static void *worker_main(void *arg) {
+  struct aes_async *queue = (struct aes_async *)arg;
+  struct aes_job **batch =
+      (struct aes_job **)malloc(queue->batch_size * sizeof(struct aes_job *));
+  struct aes_job *single;
+  unsigned int batch_size = queue->batch_size;
+  unsigned int n, i;
+
+  if (batch == NULL) {
+    batch = &single;  // out of memory: run one job at a time
+    batch_size = 1;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  for (;;) {
+    unsigned int callbacks = 0, posted = 0;
+
+    while (queue->submitted_count == 0 && !queue->stopping)
+      pthread_cond_wait(&queue->work_ready, &queue->lock);
+    if (queue->submitted_count == 0) break;
+
+    // Leave a share for every other worker, so a few large jobs run side
+    // by side instead of one after another on whoever woke first.
+    n = (queue->submitted_count + (unsigned int)queue->nbr_workers - 1) /
+        (unsigned int)queue->nbr_workers;
+    if (n > batch_size) n = batch_size;
+    for (i = 0; i < n; i++) {
+      batch[i] = queue->submitted[queue->submitted_head];
+      queue->submitted_head = (queue->submitted_head + 1) % queue->capacity;
+    }
+    queue->submitted_count -= n;
+    pthread_mutex_unlock(&queue->lock);
+
+    for (i = 0; i < n; i++) {
+      batch[i]->start_ns = now_ns();
+      run_job(batch[i]);
+      batch[i]->complete_ns = now_ns();
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->stats.batches++;
+    for (i = 0; i < n; i++) {
+      struct aes_job *job = batch[i];
+      unsigned long long latency = job->complete_ns - job->submit_ns;
+      queue->stats.completed++;
+      queue->stats.total_queue_ns += job->start_ns - job->submit_ns;
+      queue->stats.total_service_ns += job->complete_ns - job->start_ns;
+      if (latency > queue->stats.max_latency_ns)
+        queue->stats.max_latency_ns = latency;
+      if (job->callback != NULL) {
+        batch[callbacks++] = job;  // keep only the callback jobs
+      } else {
+        queue->completed[(queue->completed_head + queue->completed_count) %
+                         queue->capacity] = job;
+        queue->completed_count++;
+        posted++;
+      }
+    }
+    queue->in_flight -= callbacks;
+    if (callbacks > 0) pthread_cond_broadcast(&queue->space_ready);
+    if (posted > 0) {
+      pthread_cond_broadcast(&queue->done_ready);
+      signal_eventfd(queue);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    // Posted jobs now belong to the reaper and callback jobs to their
+    // callbacks; neither is touched again here.
+    for (i = 0; i < callbacks; i++) batch[i]->callback(batch[i]);
+    pthread_mutex_lock(&queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  if (batch != &single) free(batch);
+  return NULL;
+}
+
+/**
+ * Creates a queue and starts its workers.
+ *
+ * @param nbr_workers The number of worker threads.
+ * @param capacity The most jobs that may be between submission and reaping.
+ * @param batch_size The most jobs a worker takes at once.
+ * @return The queue, or NULL on error.
+ */
+struct aes_async *aes_async_create(int nbr_workers, unsigned int capacity,
+                                   unsigned int batch_size) {
+  struct aes_async *queue;
+  pthread_condattr_t attr;
+  int i;
+
+  if (nbr_workers < 1 || nbr_workers > AES_ASYNC_MAX_WORKERS ||
+      capacity == 0 || batch_size == 0)
+    return NULL;
+
+  queue = (struct aes_async *)calloc(1, sizeof(*queue));
+  if (queue == NULL) return NULL;
+  queue->capacity = capacity;
+  queue->batch_size = batch_size;
+  queue->submitted =
+      (struct aes_job **)calloc(capacity, sizeof(struct aes_job *));
+  queue->completed =
+      (struct aes_job **)calloc(capacity, sizeof(struct aes_job *));
+  queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (queue->submitted == NULL || queue->completed == NULL ||
+      queue->event_fd < 0) {
+    if (queue->event_fd >= 0) close(queue->event_fd);
+    free(queue->submitted);
+    free(queue->completed);
+    free(queue);
+    return NULL;
+  }
+
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->work_ready, NULL);
+  pthread_cond_init(&queue->space_ready, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&queue->done_ready, &attr);
+  pthread_condattr_destroy(&attr);
+
+  for (i = 0; i < nbr_workers; i++) {
+    if (pthread_create(&queue->workers[i], NULL, worker_main, queue) != 0)
+      break;
+    queue->nbr_workers++;
+  }
+  if (queue->nbr_workers == 0) {
+    aes_async_destroy(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+/**
+ * Lets the workers finish every submitted job, stops them and frees the
+ * queue. Completed jobs that were never reaped are simply dropped; their
+ * memory belongs to the caller.
+ *
+ * @param queue The queue.
+ */
+void aes_async_destroy(struct aes_async *queue) {
+  int i;
+
+  pthread_mutex_lock(&queue->lock);
+  queue->stopping = 1;
+  pthread_cond_broadcast(&queue->work_ready);
+  pthread_cond_broadcast(&queue->space_ready);
+  pthread_mutex_unlock(&queue->lock);
+  for (i = 0; i < queue->nbr_workers; i++)
+    pthread_join(queue->workers[i], NULL);
+
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->work_ready);
+  pthread_cond_destroy(&queue->space_ready);
+  pthread_cond_destroy(&queue->done_ready);
+  close(queue->event_fd);
+  free(queue->submitted);
+  free(queue->completed);
+  free(queue);
+}
+
+/**
+ * Queues a job with the lock held. The caller has checked for room.
+ */
+static void enqueue(struct aes_async *queue, struct aes_job *job) {
+  job->status = AES_JOB_OK;
+  job->start_ns = 0;
+  job->complete_ns = 0;
+  job->submit_ns = now_ns();
+  queue->submitted[(queue->submitted_head + queue->submitted_count) %
+                   queue->capacity] = job;
+  queue->submitted_count++;
+  queue->in_flight++;
+  pthread_cond_signal(&queue->work_ready);
+}
+
+/**
+ * Submits a job without blocking.
+ *
+ * @param queue The queue.
+ * @param job The job. It must stay valid until it completes.
+ * @return 0 if queued, -1 with errno EAGAIN if the queue is full, or -1 with
+ * errno ESHUTDOWN if the queue is being destroyed.
+ */
+int aes_async_submit(struct aes_async *queue, struct aes_job *job) {
+  int result = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->stopping) {
+    errno = ESHUTDOWN;
+    result = -1;
+  } else if (queue->in_flight == queue->capacity) {
+    errno = EAGAIN;
+    result = -1;
+  } else {
+    enqueue(queue, job);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return result;
+}
+
+/**
+ * Submits a job, blocking while the queue is full.
+ *
+ * @param queue The queue.
+ * @param job The job. It must stay valid until it completes.
+ * @return 0 if queued, -1 with errno ESHUTDOWN if the queue is being
+ * destroyed.
+ */
+int aes_async_submit_wait(struct aes_async *queue, struct aes_job *job) {
+  int result = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->in_flight == queue->capacity && !queue->stopping)
+    pthread_cond_wait(&queue->space_ready, &queue->lock);
+  if (queue->stopping) {
+    errno = ESHUTDOWN;
+    result = -1;
+  } else {
+    enqueue(queue, job);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return result;
+}
+
+/**
+ * Reaps completed jobs without blocking. The eventfd is cleared first and set
+ * again if jobs are left behind, so a caller watching it never misses one.
+ *
+ * @param queue The queue.
+ * @param jobs Where the completed jobs are stored.
+ * @param max The most jobs to reap.
+ * @return The number of jobs reaped.
+ */
+int aes_async_poll(struct aes_async *queue, struct aes_job **jobs, int max) {
+  unsigned long long counter;
+  unsigned int left;
+  int n = 0;
+  ssize_t r = read(queue->event_fd, &counter, sizeof(counter));
+  (void)r;  // EAGAIN just means it was already clear
+
+  pthread_mutex_lock(&queue->lock);
+  while (n < max && queue->completed_count > 0) {
+    jobs[n++] = queue->completed[queue->completed_head];
+    queue->completed_head = (queue->completed_head + 1) % queue->capacity;
+    queue->completed_count--;
+  }
+  queue->in_flight -= (unsigned int)n;
+  left = queue->completed_count;
+  if (n > 0) pthread_cond_broadcast(&queue->space_ready);
+  if (left > 0) signal_eventfd(queue);
+  pthread_mutex_unlock(&queue->lock);
+  return n;
+}
+
+/**
+ * Waits until completed jobs are available, then reaps them.
+ *
+ * @param queue The queue.
+ * @param jobs Where the completed jobs are stored.
+ * @param max The most jobs to reap.
+ * @param timeout_ms The longest time to wait, or -1 to wait indefinitely.
+ * @return The number of jobs reaped, 0 if the wait timed out.
+ */
+int aes_async_wait(struct aes_async *queue, struct aes_job **jobs, int max,
+                   int timeout_ms) {
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  if (timeout_ms > 0) {
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->completed_count == 0 && timeout_ms != 0) {
+    if (timeout_ms < 0) {
+      pthread_cond_wait(&queue->done_ready, &queue->lock);
+    } else if (pthread_cond_timedwait(&queue->done_ready, &queue->lock,
+                                      &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return aes_async_poll(queue, jobs, max);
+}
+
+/**
+ * Returns the eventfd that signals completed jobs, for use with poll/epoll.
+ */
+int aes_async_eventfd(struct aes_async *queue) { return queue->event_fd; }
+
+/**
+ * Copies the queue's latency and batching counters.
+ */
+void aes_async_get_stats(struct aes_async *queue,
+                         struct aes_async_stats *stats) {
+  pthread_mutex_lock(&queue->lock);
+  *stats = queue->stats;
+  pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,121 @@
+/*
+ * Salil Luley - D23124871
+ * This file, async.h, declares an asynchronous job interface for event-loop
+ * servers that must not block on large encryptions. Callers fill in a struct
+ * aes_job and submit it to a bounded submission queue. Worker threads take
+ * jobs off it in batches and run them with the modes in ocb.h, ctr.h and
+ * gcm.h or the multi-block engine. A finished job either has its callback run
+ * on the worker thread or is posted to a completion queue. That queue can be
+ * polled, waited on, or watched through an eventfd in the caller's own event
+ * loop.
+ *
+ * Memory is bounded: the queue never holds more than capacity jobs between
+ * submission and reaping, and job structures and buffers belong to the
+ * caller. A full queue is reported to aes_async_submit so the caller can back
+ * off, or aes_async_submit_wait blocks until there is room. Every job records
+ * when it was submitted, started and completed.
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+
+#include "rijndael.h"
+
+/*
+ * Job modes, and the context each expects in aes_job.ctx:
+ *   ECB      unsigned char[EXPANDED_KEY_SIZE] from expand_key
+ *   CTR      struct ctr_context, with iv holding the 16-byte counter
+ *   GCM      struct gcm_context, with an iv_len of 1 to BLOCK_SIZE
+ *   OCB      struct ocb_context, with an iv_len of at most OCB_MAX_NONCE_SIZE
+ * A job whose lengths do not fit its mode completes with AES_JOB_ERR_INVALID;
+ * AES_JOB_ERR_AUTH only ever means that the tag did not match.
+ */
+#define AES_JOB_ECB_ENCRYPT 1
+#define AES_JOB_ECB_DECRYPT 2
+#define AES_JOB_CTR 3
+#define AES_JOB_GCM_ENCRYPT 4
+#define AES_JOB_GCM_DECRYPT 5
+#define AES_JOB_OCB_ENCRYPT 6
+#define AES_JOB_OCB_DECRYPT 7
+
+/* Job status values */
+#define AES_JOB_OK 0
+#define AES_JOB_ERR_AUTH -1
+#define AES_JOB_ERR_INVALID -2
+
+struct aes_job;
+typedef void (*aes_job_callback)(struct aes_job *job);
+
+struct aes_job {
+  /* Filled in by the caller */
+  int mode;
+  void *ctx;
+  unsigned char *input;
+  unsigned char *output;
+  size_t len;
+  unsigned char iv[BLOCK_SIZE]; /* nonce, IV or CTR counter */
+  size_t iv_len;
+  unsigned char *ad;
+  size_t ad_len;
+  unsigned char tag[BLOCK_SIZE]; /* written by encryption, read by decryption */
+  aes_job_callback callback;     /* NULL to use the completion queue */
+  void *user_data;
+
+  /* Filled in by the queue */
+  int status;
+  unsigned long long submit_ns;
+  unsigned long long start_ns;
+  unsigned long long complete_ns;
+};
+
+struct aes_async_stats {
+  unsigned long long completed;
+  unsigned long long batches;
+  unsigned long long total_queue_ns;   /* submit to start */
+  unsigned long long total_service_ns; /* start to complete */
+  unsigned long long max_latency_ns;   /* submit to complete */
+};
+
+struct aes_async;
+
+/*
+ * Starts nbr_workers threads serving a queue of capacity jobs. Each worker
+ * takes up to batch_size jobs at a time, and never more than its share of
+ * the queued jobs, so that jobs are spread over the workers. A batch saves
+ * locking and wakeups but runs its jobs one by one. Returns NULL on error.
+ */
+struct aes_async *aes_async_create(int nbr_workers, unsigned int capacity,
+                                   unsigned int batch_size);
+/* Finishes every submitted job, stops the workers and frees the queue. */
+void aes_async_destroy(struct aes_async *queue);
+
+/*
+ * Return 0 if the job was queued, -1 if the queue is full or stopping.
+ *
+ * The queue owns a job from submission until it is reaped or its callback is
+ * called. A callback is called last: the job has already been counted as
+ * completed and no longer takes up room in the queue, and the worker never
+ * touches it again, so the callback may free the job or resubmit it with
+ * aes_async_submit. Callbacks should not use aes_async_submit_wait, which
+ * can block the worker that would make room.
+ */
+int aes_async_submit(struct aes_async *queue, struct aes_job *job);
+int aes_async_submit_wait(struct aes_async *queue, struct aes_job *job);
+
+/*
+ * Reap up to max completed jobs into jobs and return how many there were.
+ * aes_async_wait blocks for up to timeout_ms (-1 for no limit) until at least
+ * one job is there.
+ */
+int aes_async_poll(struct aes_async *queue, struct aes_job **jobs, int max);
+int aes_async_wait(struct aes_async *queue, struct aes_job **jobs, int max,
+                   int timeout_ms);
+
+/* An eventfd that is readable while completed jobs are waiting to be reaped. */
+int aes_async_eventfd(struct aes_async *queue);
+void aes_async_get_stats(struct aes_async *queue,
+                         struct aes_async_stats *stats);
+
+#endif
@@ -0,0 +1,460 @@
+// Salil Luley - D23124871
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aeshash.h"
+#include "async.h"
+#include "cmac.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "ocb.h"
+#include "perf.h"
+#include "rijndael.h"
+
+/**
+ * @file bench.c
+ * @brief Throughput benchmark for the block engine and the modes built on it.
+ *
+ * Usage: ./bench [--profile] [buffer size in KiB] [threads]
+ *
+ * With --profile each case also reports hardware counters per block and per
+ * byte, when the host provides them.
+ */
+
+/**
+ * Minimum time each case is repeated for, in seconds.
+ */
+#define BENCH_MIN_SECONDS 0.5
+
+/**
+ * @brief One entry of the benchmark table.
+ */
+struct bench_case {
+  const char *name;
+  void (*run)(unsigned char *buffer, size_t len);
+};
+
+unsigned char bench_key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                               75, 17, 51, 17, 4,  8, 6,  99};
+unsigned char bench_mac_key[16] = {99, 6,  8,  4,  17, 51, 17, 75,
+                                   27, 70, 9,  67, 86, 46, 20, 50};
+unsigned char bench_nonce[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+unsigned char bench_expanded_key[EXPANDED_KEY_SIZE];
+unsigned char bench_tag[OCB_TAG_SIZE];
+struct ocb_context bench_ocb;
+struct aes_hash_key bench_hash_key;
+struct ctr_context bench_ctr;
+struct gcm_context bench_gcm;
+struct cmac_context bench_cmac;
+struct aes_async *bench_async;
+volatile unsigned long long bench_hash_sink;
+int bench_threads = 1;
+struct perf_counters bench_perf;
+int bench_profile = 0;
+
+/**
+ * Size of the keys used by the small-key hash cases, typical of hash tables.
+ */
+#define BENCH_HASH_KEY_SIZE 16
+
+/**
+ * Fragment size for the iovec cases, a typical packet payload. It is not a
+ * multiple of the block size, so blocks straddle fragments.
+ */
+#define BENCH_FRAGMENT_SIZE 1500
+
+/**
+ * Job size and queue shape for the asynchronous case.
+ */
+#define BENCH_JOB_SIZE (16 * 1024)
+#define BENCH_QUEUE_CAPACITY 64
+#define BENCH_QUEUE_BATCH 8
+
+/**
+ * Returns a monotonic timestamp in seconds.
+ */
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The bare round kernels, one block at a time with a fixed schedule.
+ */
+void run_aes_main(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    aes_main(buffer + i, bench_expanded_key, NBR_ROUNDS);
+}
+
+void run_aes_inv_main(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    aes_inv_main(buffer + i, bench_expanded_key, NBR_ROUNDS);
+}
+
+/**
+ * Expands every block of the buffer as a key.
+ */
+void run_expand_key(unsigned char *buffer, size_t len) {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    expand_key(expanded_key, buffer + i);
+  bench_hash_sink += expanded_key[EXPANDED_KEY_SIZE - 1];
+}
+
+/**
+ * Encrypts the buffer one block at a time through aes_encrypt_block, which
+ * expands the key and allocates for every block.
+ */
+void run_encrypt_block(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE) {
+    unsigned char *output = aes_encrypt_block(buffer + i, bench_key);
+    memcpy(buffer + i, output, BLOCK_SIZE);
+    free(output);
+  }
+}
+
+/**
+ * One-shot keys: every block is encrypted under its own key (the block
+ * itself), expanding the schedule onto the stack first. With the byte-wise
+ * rounds, expand_key costs about a twentieth of aes_main, so the on-the-fly
+ * cases can save at most about 5% here. That is less than the run-to-run
+ * noise of a shared host.
+ */
+void run_expand_encrypt(unsigned char *buffer, size_t len) {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE) {
+    expand_key(expanded_key, buffer + i);
+    aes_encrypt_blocks(buffer + i, buffer + i, 1, expanded_key);
+  }
+}
+
+void run_encrypt_block_otf(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    aes_encrypt_block_otf(buffer + i, buffer + i, buffer + i);
+}
+
+void run_expand_decrypt(unsigned char *buffer, size_t len) {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE) {
+    expand_key(expanded_key, buffer + i);
+    aes_decrypt_blocks(buffer + i, buffer + i, 1, expanded_key);
+  }
+}
+
+void run_decrypt_block_otf(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    aes_decrypt_block_otf(buffer + i, buffer + i, buffer + i);
+}
+
+void run_encrypt_blocks(unsigned char *buffer, size_t len) {
+  aes_encrypt_blocks(buffer, buffer, len / BLOCK_SIZE, bench_expanded_key);
+}
+
+void run_ocb_encrypt(unsigned char *buffer, size_t len) {
+  ocb_encrypt(&bench_ocb, bench_nonce, sizeof(bench_nonce), NULL, 0, buffer,
+              len, buffer, bench_tag);
+}
+
+void run_ocb_decrypt(unsigned char *buffer, size_t len) {
+  // The tag will not match; the work done before the comparison is the same.
+  ocb_decrypt(&bench_ocb, bench_nonce, sizeof(bench_nonce), NULL, 0, buffer,
+              len, bench_tag, buffer);
+}
+
+void run_ocb_encrypt_mt(unsigned char *buffer, size_t len) {
+  ocb_encrypt_mt(&bench_ocb, bench_nonce, sizeof(bench_nonce), NULL, 0, buffer,
+                 len, buffer, bench_tag, bench_threads);
+}
+
+void run_ctr_crypt(unsigned char *buffer, size_t len) {
+  unsigned char counter[BLOCK_SIZE] = {0};
+  ctr_crypt(&bench_ctr, counter, buffer, buffer, len);
+}
+
+/**
+ * Encrypt-then-MAC with CTR and CMAC, the generic composition that OCB and
+ * GCM replace. CMAC is serial, so it cannot batch blocks like CTR does.
+ */
+void run_ctr_cmac(unsigned char *buffer, size_t len) {
+  unsigned char counter[BLOCK_SIZE] = {0};
+  ctr_crypt(&bench_ctr, counter, buffer, buffer, len);
+  cmac(&bench_cmac, buffer, len, bench_tag);
+}
+
+void run_gcm_encrypt(unsigned char *buffer, size_t len) {
+  gcm_encrypt(&bench_gcm, bench_nonce, sizeof(bench_nonce), NULL, 0, buffer,
+              len, buffer, bench_tag);
+}
+
+/**
+ * Describes the buffer as a chain of BENCH_FRAGMENT_SIZE fragments.
+ *
+ * @return The iovecs, which the caller frees, and their count in *count.
+ */
+struct iovec *fragment_buffer(unsigned char *buffer, size_t len, int *count) {
+  int n = (int)((len + BENCH_FRAGMENT_SIZE - 1) / BENCH_FRAGMENT_SIZE);
+  struct iovec *iov = malloc(n * sizeof(struct iovec));
+  for (int i = 0; i < n; i++) {
+    size_t start = (size_t)i * BENCH_FRAGMENT_SIZE;
+    iov[i].iov_base = buffer + start;
+    iov[i].iov_len =
+        len - start < BENCH_FRAGMENT_SIZE ? len - start : BENCH_FRAGMENT_SIZE;
+  }
+  *count = n;
+  return iov;
+}
+
+void run_ctr_crypt_iov(unsigned char *buffer, size_t len) {
+  unsigned char counter[BLOCK_SIZE] = {0};
+  int count;
+  struct iovec *iov = fragment_buffer(buffer, len, &count);
+  ctr_crypt_iov(&bench_ctr, counter, iov, count, iov, count);
+  free(iov);
+}
+
+void run_gcm_encrypt_iov(unsigned char *buffer, size_t len) {
+  int count;
+  struct iovec *iov = fragment_buffer(buffer, len, &count);
+  gcm_encrypt_iov(&bench_gcm, bench_nonce, sizeof(bench_nonce), NULL, 0, iov,
+                  count, iov, count, bench_tag);
+  free(iov);
+}
+
+/**
+ * Encrypts the buffer as BENCH_JOB_SIZE GCM jobs through the asynchronous
+ * queue, reaping completions whenever the queue is full.
+ */
+void run_async_gcm(unsigned char *buffer, size_t len) {
+  size_t nbr_jobs = (len + BENCH_JOB_SIZE - 1) / BENCH_JOB_SIZE;
+  struct aes_job *jobs = calloc(nbr_jobs, sizeof(struct aes_job));
+  struct aes_job *done[BENCH_QUEUE_CAPACITY];
+  size_t submitted = 0, reaped = 0;
+
+  for (size_t i = 0; i < nbr_jobs; i++) {
+    size_t start = i * BENCH_JOB_SIZE;
+    jobs[i].mode = AES_JOB_GCM_ENCRYPT;
+    jobs[i].ctx = &bench_gcm;
+    jobs[i].input = buffer + start;
+    jobs[i].output = buffer + start;
+    jobs[i].len = len - start < BENCH_JOB_SIZE ? len - start : BENCH_JOB_SIZE;
+    memcpy(jobs[i].iv, bench_nonce, sizeof(bench_nonce));
+    jobs[i].iv_len = sizeof(bench_nonce);
+  }
+  while (reaped < nbr_jobs) {
+    while (submitted < nbr_jobs &&
+           aes_async_submit(bench_async, &jobs[submitted]) == 0)
+      submitted++;
+    reaped += aes_async_wait(bench_async, done, BENCH_QUEUE_CAPACITY, -1);
+  }
+  free(jobs);
+}
+
+/**
+ * 64-bit FNV-1a, the usual byte-at-a-time baseline for hash tables.
+ */
+unsigned long long fnv1a64(const unsigned char *data, size_t len) {
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/**
+ * MurmurHash64A by Austin Appleby, a common word-at-a-time baseline.
+ */
+unsigned long long murmur64a(const unsigned char *data, size_t len,
+                             unsigned long long seed) {
+  const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  unsigned long long h = seed ^ (len * m);
+  size_t full = len / 8;
+
+  for (size_t i = 0; i < full; i++) {
+    unsigned long long k;
+    memcpy(&k, data + i * 8, 8);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  data += full * 8;
+  switch (len & 7) {
+    case 7:
+      h ^= (unsigned long long)data[6] << 48;  // fall through
+    case 6:
+      h ^= (unsigned long long)data[5] << 40;  // fall through
+    case 5:
+      h ^= (unsigned long long)data[4] << 32;  // fall through
+    case 4:
+      h ^= (unsigned long long)data[3] << 24;  // fall through
+    case 3:
+      h ^= (unsigned long long)data[2] << 16;  // fall through
+    case 2:
+      h ^= (unsigned long long)data[1] << 8;  // fall through
+    case 1:
+      h ^= (unsigned long long)data[0];
+      h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+void run_aes_hash64(unsigned char *buffer, size_t len) {
+  bench_hash_sink = aes_hash64(&bench_hash_key, buffer, len);
+}
+
+/**
+ * aes_hash64 forced onto the portable rounds, for comparison with AES-NI.
+ */
+void run_aes_hash64_portable(unsigned char *buffer, size_t len) {
+  aes_hash_select(0);
+  bench_hash_sink = aes_hash64(&bench_hash_key, buffer, len);
+  aes_hash_select(1);
+}
+
+void run_fnv1a64(unsigned char *buffer, size_t len) {
+  bench_hash_sink = fnv1a64(buffer, len);
+}
+
+void run_murmur64a(unsigned char *buffer, size_t len) {
+  bench_hash_sink = murmur64a(buffer, len, 0);
+}
+
+void run_aes_hash64_keys(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BENCH_HASH_KEY_SIZE <= len; i += BENCH_HASH_KEY_SIZE)
+    bench_hash_sink ^= aes_hash64(&bench_hash_key, buffer + i,
+                                  BENCH_HASH_KEY_SIZE);
+}
+
+void run_fnv1a64_keys(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BENCH_HASH_KEY_SIZE <= len; i += BENCH_HASH_KEY_SIZE)
+    bench_hash_sink ^= fnv1a64(buffer + i, BENCH_HASH_KEY_SIZE);
+}
+
+void run_murmur64a_keys(unsigned char *buffer, size_t len) {
+  for (size_t i = 0; i + BENCH_HASH_KEY_SIZE <= len; i += BENCH_HASH_KEY_SIZE)
+    bench_hash_sink ^= murmur64a(buffer + i, BENCH_HASH_KEY_SIZE, 0);
+}
+
+struct bench_case bench_cases[] = {
+    {"aes_main", run_aes_main},
+    {"aes_inv_main", run_aes_inv_main},
+    {"expand_key", run_expand_key},
+    {"aes_encrypt_block", run_encrypt_block},
+    {"aes_encrypt_blocks", run_encrypt_blocks},
+    {"expand+encrypt one-shot", run_expand_encrypt},
+    {"aes_encrypt_block_otf", run_encrypt_block_otf},
+    {"expand+decrypt one-shot", run_expand_decrypt},
+    {"aes_decrypt_block_otf", run_decrypt_block_otf},
+    {"ocb_encrypt", run_ocb_encrypt},
+    {"ocb_decrypt", run_ocb_decrypt},
+    {"ocb_encrypt_mt", run_ocb_encrypt_mt},
+    {"ctr_crypt", run_ctr_crypt},
+    {"ctr+cmac", run_ctr_cmac},
+    {"ctr_crypt_iov 1500B", run_ctr_crypt_iov},
+    {"gcm_encrypt", run_gcm_encrypt},
+    {"gcm_encrypt_iov 1500B", run_gcm_encrypt_iov},
+    {"async gcm 16KiB jobs", run_async_gcm},
+    {"aes_hash64", run_aes_hash64},
+    {"aes_hash64 portable", run_aes_hash64_portable},
+    {"fnv1a64", run_fnv1a64},
+    {"murmur64a", run_murmur64a},
+    {"aes_hash64 16B keys", run_aes_hash64_keys},
+    {"fnv1a64 16B keys", run_fnv1a64_keys},
+    {"murmur64a 16B keys", run_murmur64a_keys},
+};
+
+/**
+ * Runs one case repeatedly for at least BENCH_MIN_SECONDS and prints its
+ * throughput, or in profiling mode its time and counters per block and per
+ * byte.
+ *
+ * @param bench The case to run.
+ * @param buffer The working buffer.
+ * @param len The length of the buffer in bytes.
+ */
+void run_case(struct bench_case *bench, unsigned char *buffer, size_t len) {
+  double start, elapsed;
+  long iterations = 0;
+
+  struct perf_reading reading;
+
+  bench->run(buffer, len);  // warm up
+  if (bench_profile) perf_start(&bench_perf);
+  start = now_seconds();
+  do {
+    bench->run(buffer, len);
+    iterations++;
+    elapsed = now_seconds() - start;
+  } while (elapsed < BENCH_MIN_SECONDS);
+
+  if (bench_profile) {
+    perf_stop(&bench_perf, &reading);
+    perf_report(bench->name, bench_perf.nbr_open > 0 ? &reading : NULL,
+                elapsed, (unsigned long long)len * iterations);
+    return;
+  }
+  printf("%-24s %10.2f MB/s %10.1f ns/block\n", bench->name,
+         (double)len * iterations / elapsed / 1e6,
+         elapsed * 1e9 / ((double)iterations * (len / BLOCK_SIZE)));
+}
+
+/**
+ * @brief Entry point of the benchmark.
+ * @return 0 on success, 1 if the buffer or the job queue cannot be set up.
+ */
+int main(int argc, char **argv) {
+  size_t len = 1024 * 1024;
+  unsigned char *buffer;
+
+  if (argc > 1 && strcmp(argv[1], "--profile") == 0) {
+    bench_profile = 1;
+    argc--;
+    argv++;
+  }
+  if (argc > 1) len = (size_t)atol(argv[1]) * 1024;
+  if (argc > 2)
+    bench_threads = atoi(argv[2]);
+  else
+    bench_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (len < BLOCK_SIZE) len = BLOCK_SIZE;
+  if (bench_threads < 1) bench_threads = 1;
+
+  buffer = (unsigned char *)malloc(len);
+  if (buffer == NULL) return 1;
+  for (size_t i = 0; i < len; i++) buffer[i] = (unsigned char)i;
+
+  expand_key(bench_expanded_key, bench_key);
+  ocb_init(&bench_ocb, bench_key);
+  aes_hash_init(&bench_hash_key, bench_key);
+  ctr_init(&bench_ctr, bench_key);
+  gcm_init(&bench_gcm, bench_key);
+  cmac_init(&bench_cmac, bench_mac_key);
+  // The counters follow threads started after they are opened, so open them
+  // before the async workers exist and the threaded cases are fully counted.
+  printf("buffer %zu bytes, %d threads\n", len, bench_threads);
+  if (bench_profile && perf_open(&bench_perf) == 0)
+    printf("perf events unavailable (%s), reporting time only\n",
+           strerror(bench_perf.error));
+  bench_async =
+      aes_async_create(bench_threads, BENCH_QUEUE_CAPACITY, BENCH_QUEUE_BATCH);
+  if (bench_async == NULL) return 1;
+
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+    run_case(&bench_cases[i], buffer, len);
+
+  if (bench_profile) perf_close(&bench_perf);
+  aes_async_destroy(bench_async);
+  free(buffer);
+  return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ *  Salil Luley - D23124871
+ * CMAC over the multi-block engine, one block at a time.
+ */
+
+#include "cmac.h"
+
+#include <string.h>
+
+/**
+ * Doubles a block in GF(2^128) as CMAC defines it: a left shift by one bit,
+ * with the constant 0x87 folded into the last byte if a bit falls off.
+ *
+ * @param out The doubled block.
+ * @param in The block to double.
+ */
+static void cmac_double(unsigned char *out, const unsigned char *in) {
+  unsigned char carry = in[0] >> 7;
+  int i;
+  for (i = 0; i < BLOCK_SIZE - 1; i++)
+    out[i] = (unsigned char)((in[i] << 1) | (in[i + 1] >> 7));
+  out[BLOCK_SIZE - 1] = (unsigned char)((in[BLOCK_SIZE - 1] << 1) ^
+                                        (carry ? 0x87 : 0));
+}
+
+/**
+ * Prepares a context for use with the given key: expands the key and derives
+ * the subkeys K1 = 2 * E(0) and K2 = 4 * E(0).
+ *
+ * @param ctx The context to initialise.
+ * @param key The 16-byte key.
+ */
+void cmac_init(struct cmac_context *ctx, unsigned char *key) {
+  unsigned char l[BLOCK_SIZE] = {0};
+
+  expand_key(ctx->expanded_key, key);
+  aes_encrypt_blocks(l, l, 1, ctx->expanded_key);
+  cmac_double(ctx->k1, l);
+  cmac_double(ctx->k2, ctx->k1);
+}
+
+/**
+ * Computes the CMAC of a message. Every block but the last is chained
+ * through the cipher; the last is XORed with K1 if it is complete, or padded
+ * with 0x80 0x00... and XORed with K2 if it is partial or the message is
+ * empty.
+ *
+ * @param ctx The context initialised with cmac_init.
+ * @param data The message.
+ * @param len The length of the message in bytes.
+ * @param tag Where the 16-byte tag is written.
+ */
+void cmac(struct cmac_context *ctx, const unsigned char *data, size_t len,
+          unsigned char *tag) {
+  unsigned char x[BLOCK_SIZE] = {0};
+  unsigned char last[BLOCK_SIZE];
+  size_t nbr_blocks = len == 0 ? 1 : (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  size_t rem = len - (nbr_blocks - 1) * BLOCK_SIZE;
+  size_t i, j;
+
+  for (i = 0; i + 1 < nbr_blocks; i++) {
+    for (j = 0; j < BLOCK_SIZE; j++) x[j] ^= data[i * BLOCK_SIZE + j];
+    aes_encrypt_blocks(x, x, 1, ctx->expanded_key);
+  }
+
+  memset(last, 0, BLOCK_SIZE);
+  if (rem > 0) memcpy(last, data + (nbr_blocks - 1) * BLOCK_SIZE, rem);
+  if (rem == BLOCK_SIZE) {
+    for (j = 0; j < BLOCK_SIZE; j++) last[j] ^= ctx->k1[j];
+  } else {
+    last[rem] = 0x80;
+    for (j = 0; j < BLOCK_SIZE; j++) last[j] ^= ctx->k2[j];
+  }
+  for (j = 0; j < BLOCK_SIZE; j++) x[j] ^= last[j];
+  aes_encrypt_blocks(x, tag, 1, ctx->expanded_key);
+}
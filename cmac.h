@@ -0,0 +1,31 @@
+/*
+ * Salil Luley - D23124871
+ * This file, cmac.h, declares CMAC (NIST SP 800-38B, RFC 4493) on top of the
+ * AES-128 block functions in rijndael.h. CMAC is a CBC-MAC whose last block
+ * is masked with one of two subkeys derived from the key, so it is secure for
+ * messages of any length. It is here mainly to pair with CTR mode (ctr.h) as
+ * the encrypt-then-MAC baseline that OCB and GCM are measured against. Unlike
+ * those modes it is serial: each block needs the previous block's result.
+ */
+
+#ifndef CMAC_H
+#define CMAC_H
+
+#include <stddef.h>
+
+#include "rijndael.h"
+
+#define CMAC_TAG_SIZE 16
+
+struct cmac_context {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char k1[BLOCK_SIZE];
+  unsigned char k2[BLOCK_SIZE];
+};
+
+void cmac_init(struct cmac_context *ctx, unsigned char *key);
+/* Computes the 16-byte tag of len bytes of data. */
+void cmac(struct cmac_context *ctx, const unsigned char *data, size_t len,
+          unsigned char *tag);
+
+#endif
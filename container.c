@@ -0,0 +1,684 @@
+/**
+ *  Salil Luley - D23124871
+ * A seekable container of independently encrypted OCB chunks, with a
+ * streaming writer and random-access reader that both work across threads.
+ */
+
+#include "container.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ocb.h"
+
+#define CONTAINER_SALT_OFFSET 16
+#define CONTAINER_SALT_SIZE 16
+#define CONTAINER_NONCE_SIZE 4
+#define CONTAINER_CHUNK_AD_SIZE (CONTAINER_HEADER_SIZE + 9)
+
+/**
+ * The chunk number used in the nonce of the index tag. Real chunks are
+ * numbered below it.
+ */
+#define CONTAINER_INDEX_NUMBER 0xffffffffUL
+
+#define CONTAINER_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+#define CONTAINER_MAX_THREADS 64
+
+static const unsigned char container_magic[4] = {'A', 'E', 'S', 'C'};
+static const unsigned char container_footer_magic[8] = {'A', 'E', 'S', 'C',
+                                                        'I', 'D', 'X', '1'};
+
+struct container_writer {
+  int fd;
+  struct ocb_context ctx;
+  unsigned char header[CONTAINER_HEADER_SIZE];
+  unsigned int chunk_size;
+  int nbr_threads;
+  unsigned char *buffer;  // plain_text of up to nbr_threads chunks
+  size_t buffered;
+  unsigned char *sealed;  // the encrypted form of buffer
+  unsigned char *index;
+  size_t index_capacity;
+  unsigned long chunk_count;
+  unsigned long long offset;  // file offset of the next chunk
+  unsigned long long plain_size;
+};
+
+struct container_reader {
+  int fd;
+  struct ocb_context ctx;
+  unsigned char header[CONTAINER_HEADER_SIZE];
+  unsigned int chunk_size;
+  int nbr_threads;
+  unsigned char *index;
+  unsigned long chunk_count;
+  unsigned long long plain_size;
+};
+
+/**
+ * One chunk to seal or open. For opening, the chunk is decrypted straight into
+ * the caller's buffer when the whole chunk is wanted, and into scratch space
+ * otherwise.
+ */
+struct chunk_job {
+  struct ocb_context *ctx;
+  unsigned char *header;
+  unsigned long number;
+  int final;
+  unsigned char *input;
+  size_t len;
+  unsigned char *output;
+  int fd;
+  unsigned long long file_offset;
+  size_t copy_from;
+  size_t copy_len;
+  int result;
+};
+
+/**
+ * Work shared by the threads of run_jobs. Thread t takes jobs t, t + stride,
+ * t + 2 * stride and so on.
+ */
+struct job_runner {
+  void (*fn)(struct chunk_job *job);
+  struct chunk_job *jobs;
+  size_t nbr_jobs;
+  size_t first;
+  size_t stride;
+};
+
+static void put_u16(unsigned char *p, unsigned int v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, unsigned long v) {
+  int i;
+  for (i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, unsigned long long v) {
+  int i;
+  for (i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned int get_u16(const unsigned char *p) {
+  return p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned long get_u32(const unsigned char *p) {
+  unsigned long v = 0;
+  int i;
+  for (i = 0; i < 4; i++) v |= (unsigned long)p[i] << (8 * i);
+  return v;
+}
+
+static unsigned long long get_u64(const unsigned char *p) {
+  unsigned long long v = 0;
+  int i;
+  for (i = 0; i < 8; i++) v |= (unsigned long long)p[i] << (8 * i);
+  return v;
+}
+
+/**
+ * Writes a whole buffer, retrying on short writes and interrupts.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int write_full(int fd, const unsigned char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    data += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/**
+ * Reads a whole buffer at a file offset, retrying on short reads and
+ * interrupts.
+ *
+ * @return 0 on success, -1 on error or end of file.
+ */
+static int read_full(int fd, unsigned char *data, size_t len,
+                     unsigned long long offset) {
+  while (len > 0) {
+    ssize_t n = pread(fd, data, len, (off_t)offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    data += n;
+    len -= (size_t)n;
+    offset += (unsigned long long)n;
+  }
+  return 0;
+}
+
+/**
+ * Sets up the OCB context of one file. Its key is the file's salt encrypted
+ * under the caller's key, so nonces only have to be unique within a file:
+ * two files share a key only if their 128-bit salts collide.
+ *
+ * @param ctx The context to set up.
+ * @param key The caller's 16-byte key.
+ * @param header The file header, holding the salt.
+ */
+static void file_key_init(struct ocb_context *ctx, unsigned char *key,
+                          unsigned char *header) {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char file_key[BLOCK_SIZE];
+
+  expand_key(expanded_key, key);
+  aes_encrypt_blocks(header + CONTAINER_SALT_OFFSET, file_key, 1,
+                     expanded_key);
+  ocb_init(ctx, file_key);
+  memset(expanded_key, 0, sizeof(expanded_key));
+  memset(file_key, 0, sizeof(file_key));
+}
+
+/**
+ * Builds the nonce for a chunk number: the number in big-endian order. It is
+ * unique within the file, and the file key is unique to the file.
+ */
+static void chunk_nonce(unsigned long number, unsigned char *nonce) {
+  nonce[0] = (unsigned char)(number >> 24);
+  nonce[1] = (unsigned char)(number >> 16);
+  nonce[2] = (unsigned char)(number >> 8);
+  nonce[3] = (unsigned char)number;
+}
+
+/**
+ * Builds the associated data for a chunk: the header, the chunk number and
+ * the final-chunk flag.
+ */
+static void chunk_ad(unsigned char *header, unsigned long number, int final,
+                     unsigned char *ad) {
+  memcpy(ad, header, CONTAINER_HEADER_SIZE);
+  put_u64(ad + CONTAINER_HEADER_SIZE, number);
+  ad[CONTAINER_HEADER_SIZE + 8] = final ? 1 : 0;
+}
+
+/**
+ * Encrypts one chunk into job->output, followed by its tag.
+ */
+static void seal_chunk(struct chunk_job *job) {
+  unsigned char nonce[CONTAINER_NONCE_SIZE];
+  unsigned char ad[CONTAINER_CHUNK_AD_SIZE];
+
+  chunk_nonce(job->number, nonce);
+  chunk_ad(job->header, job->number, job->final, ad);
+  job->result =
+      ocb_encrypt(job->ctx, nonce, sizeof(nonce), ad, sizeof(ad), job->input,
+                  job->len, job->output, job->output + job->len);
+}
+
+/**
+ * Reads and decrypts one chunk, then copies the wanted part of it into
+ * job->output.
+ */
+static void open_chunk(struct chunk_job *job) {
+  unsigned char nonce[CONTAINER_NONCE_SIZE];
+  unsigned char ad[CONTAINER_CHUNK_AD_SIZE];
+  unsigned char tag[OCB_TAG_SIZE];
+  unsigned char *scratch = NULL;
+  unsigned char *plain_text = job->output;
+
+  job->result = -1;
+  if (job->copy_from != 0 || job->copy_len != job->len) {
+    scratch = (unsigned char *)malloc(job->len);
+    if (scratch == NULL) return;
+    plain_text = scratch;
+  }
+
+  if (read_full(job->fd, plain_text, job->len, job->file_offset) == 0 &&
+      read_full(job->fd, tag, OCB_TAG_SIZE, job->file_offset + job->len) ==
+          0) {
+    chunk_nonce(job->number, nonce);
+    chunk_ad(job->header, job->number, job->final, ad);
+    job->result = ocb_decrypt(job->ctx, nonce, sizeof(nonce), ad, sizeof(ad),
+                              plain_text, job->len, tag, plain_text);
+  }
+
+  if (scratch != NULL) {
+    if (job->result == 0)
+      memcpy(job->output, scratch + job->copy_from, job->copy_len);
+    free(scratch);
+  }
+}
+
+/**
+ * Thread entry point for run_jobs.
+ */
+static void *job_thread(void *arg) {
+  struct job_runner *runner = (struct job_runner *)arg;
+  size_t i;
+  for (i = runner->first; i < runner->nbr_jobs; i += runner->stride)
+    runner->fn(&runner->jobs[i]);
+  return NULL;
+}
+
+/**
+ * Runs fn over every job, spread over up to nbr_threads threads. The calling
+ * thread does its share, and the share of any thread that fails to start.
+ */
+static void run_jobs(void (*fn)(struct chunk_job *job), struct chunk_job *jobs,
+                     size_t nbr_jobs, int nbr_threads) {
+  struct job_runner runners[CONTAINER_MAX_THREADS];
+  pthread_t threads[CONTAINER_MAX_THREADS];
+  int started[CONTAINER_MAX_THREADS] = {0};
+  size_t stride;
+  int t;
+
+  if (nbr_threads > CONTAINER_MAX_THREADS) nbr_threads = CONTAINER_MAX_THREADS;
+  if ((size_t)nbr_threads > nbr_jobs) nbr_threads = (int)nbr_jobs;
+  if (nbr_threads < 1) nbr_threads = 1;
+  stride = (size_t)nbr_threads;
+
+  for (t = 0; t < nbr_threads; t++) {
+    runners[t].fn = fn;
+    runners[t].jobs = jobs;
+    runners[t].nbr_jobs = nbr_jobs;
+    runners[t].first = (size_t)t;
+    runners[t].stride = stride;
+  }
+  for (t = 1; t < nbr_threads; t++)
+    started[t] =
+        pthread_create(&threads[t], NULL, job_thread, &runners[t]) == 0;
+  job_thread(&runners[0]);
+  for (t = 1; t < nbr_threads; t++) {
+    if (started[t])
+      pthread_join(threads[t], NULL);
+    else
+      job_thread(&runners[t]);
+  }
+}
+
+/**
+ * Fills a buffer from /dev/urandom.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int random_bytes(unsigned char *data, size_t len) {
+  int fd = open("/dev/urandom", O_RDONLY);
+  int result = 0;
+  if (fd < 0) return -1;
+  while (len > 0) {
+    ssize_t n = read(fd, data, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      result = -1;
+      break;
+    }
+    data += n;
+    len -= (size_t)n;
+  }
+  close(fd);
+  return result;
+}
+
+/**
+ * Computes the tag that authenticates the index: an OCB tag with no
+ * plain_text over the header, the index entries and the start of the footer.
+ *
+ * @return 0 on success, -1 if memory runs out.
+ */
+static int index_tag(struct ocb_context *ctx, unsigned char *header,
+                     unsigned char *index, unsigned long chunk_count,
+                     unsigned char *footer, unsigned char *tag) {
+  size_t index_len = (size_t)chunk_count * CONTAINER_INDEX_ENTRY_SIZE;
+  size_t ad_len = CONTAINER_HEADER_SIZE + index_len + 16;
+  unsigned char nonce[CONTAINER_NONCE_SIZE];
+  unsigned char *ad = (unsigned char *)malloc(ad_len);
+  int result;
+
+  if (ad == NULL) return -1;
+  memcpy(ad, header, CONTAINER_HEADER_SIZE);
+  if (index_len > 0) memcpy(ad + CONTAINER_HEADER_SIZE, index, index_len);
+  memcpy(ad + CONTAINER_HEADER_SIZE + index_len, footer, 16);
+  chunk_nonce(CONTAINER_INDEX_NUMBER, nonce);
+  result = ocb_encrypt(ctx, nonce, sizeof(nonce), ad, ad_len, NULL, 0, NULL,
+                       tag);
+  free(ad);
+  return result;
+}
+
+/**
+ * Starts a new container and writes its header.
+ *
+ * @param fd The file descriptor to write to.
+ * @param key The 16-byte key.
+ * @param chunk_size The plain_text size of each chunk, or 0 for the default.
+ * @param nbr_threads The number of threads used to encrypt chunks.
+ * @return The writer, or NULL on error.
+ */
+struct container_writer *container_writer_open(int fd, unsigned char *key,
+                                               unsigned int chunk_size,
+                                               int nbr_threads) {
+  struct container_writer *writer;
+
+  if (chunk_size == 0) chunk_size = CONTAINER_DEFAULT_CHUNK_SIZE;
+  if (chunk_size > CONTAINER_MAX_CHUNK_SIZE) return NULL;
+  if (nbr_threads < 1) nbr_threads = 1;
+  if (nbr_threads > CONTAINER_MAX_THREADS) nbr_threads = CONTAINER_MAX_THREADS;
+
+  writer = (struct container_writer *)calloc(1, sizeof(*writer));
+  if (writer == NULL) return NULL;
+  writer->fd = fd;
+  writer->chunk_size = chunk_size;
+  writer->nbr_threads = nbr_threads;
+  writer->buffer = (unsigned char *)malloc((size_t)nbr_threads * chunk_size);
+  writer->sealed = (unsigned char *)malloc((size_t)nbr_threads *
+                                           (chunk_size + OCB_TAG_SIZE));
+
+  memcpy(writer->header, container_magic, sizeof(container_magic));
+  put_u16(writer->header + 4, CONTAINER_VERSION);
+  put_u16(writer->header + 6, 0);
+  put_u32(writer->header + 8, chunk_size);
+
+  if (writer->buffer == NULL || writer->sealed == NULL ||
+      random_bytes(writer->header + CONTAINER_SALT_OFFSET,
+                   CONTAINER_SALT_SIZE) != 0 ||
+      write_full(fd, writer->header, CONTAINER_HEADER_SIZE) != 0) {
+    free(writer->buffer);
+    free(writer->sealed);
+    free(writer);
+    return NULL;
+  }
+  file_key_init(&writer->ctx, key, writer->header);
+  writer->offset = CONTAINER_HEADER_SIZE;
+  return writer;
+}
+
+/**
+ * Encrypts the buffered chunks in parallel, writes them out and records them
+ * in the index.
+ *
+ * @param writer The writer.
+ * @param final Non-zero if the last buffered chunk ends the container.
+ * @return 0 on success, -1 on error.
+ */
+static int writer_flush(struct container_writer *writer, int final) {
+  struct chunk_job jobs[CONTAINER_MAX_THREADS];
+  size_t nbr_chunks =
+      (writer->buffered + writer->chunk_size - 1) / writer->chunk_size;
+  size_t sealed_len = 0;
+  size_t i;
+
+  if (nbr_chunks == 0) return 0;
+  if (writer->chunk_count + nbr_chunks >= CONTAINER_INDEX_NUMBER) return -1;
+
+  if ((writer->chunk_count + nbr_chunks) * CONTAINER_INDEX_ENTRY_SIZE >
+      writer->index_capacity) {
+    size_t capacity = writer->index_capacity ? writer->index_capacity * 2
+                                             : 64 * CONTAINER_INDEX_ENTRY_SIZE;
+    unsigned char *index;
+    while (capacity <
+           (writer->chunk_count + nbr_chunks) * CONTAINER_INDEX_ENTRY_SIZE)
+      capacity *= 2;
+    index = (unsigned char *)realloc(writer->index, capacity);
+    if (index == NULL) return -1;
+    writer->index = index;
+    writer->index_capacity = capacity;
+  }
+
+  for (i = 0; i < nbr_chunks; i++) {
+    size_t start = i * writer->chunk_size;
+    size_t len = writer->buffered - start;
+    if (len > writer->chunk_size) len = writer->chunk_size;
+
+    memset(&jobs[i], 0, sizeof(jobs[i]));
+    jobs[i].ctx = &writer->ctx;
+    jobs[i].header = writer->header;
+    jobs[i].number = writer->chunk_count + i;
+    jobs[i].final = final && i == nbr_chunks - 1;
+    jobs[i].input = writer->buffer + start;
+    jobs[i].len = len;
+    jobs[i].output = writer->sealed + sealed_len;
+    sealed_len += len + OCB_TAG_SIZE;
+  }
+  run_jobs(seal_chunk, jobs, nbr_chunks, writer->nbr_threads);
+
+  for (i = 0; i < nbr_chunks; i++) {
+    unsigned char *entry =
+        writer->index + (writer->chunk_count + i) * CONTAINER_INDEX_ENTRY_SIZE;
+    if (jobs[i].result != 0) return -1;
+    put_u64(entry, writer->offset);
+    put_u32(entry + 8, (unsigned long)jobs[i].len);
+    put_u32(entry + 12, 0);
+    writer->offset += jobs[i].len + OCB_TAG_SIZE;
+  }
+  if (write_full(writer->fd, writer->sealed, sealed_len) != 0) return -1;
+
+  writer->chunk_count += nbr_chunks;
+  writer->buffered = 0;
+  return 0;
+}
+
+/**
+ * Appends plain_text to the container. Data is buffered until a batch of
+ * nbr_threads chunks is complete and more data arrives, so the final chunk is
+ * only sealed by container_writer_close.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int container_writer_write(struct container_writer *writer,
+                           const unsigned char *data, size_t len) {
+  size_t capacity = (size_t)writer->nbr_threads * writer->chunk_size;
+
+  while (len > 0) {
+    size_t n;
+    if (writer->buffered == capacity && writer_flush(writer, 0) != 0)
+      return -1;
+    n = capacity - writer->buffered;
+    if (n > len) n = len;
+    memcpy(writer->buffer + writer->buffered, data, n);
+    writer->buffered += n;
+    writer->plain_size += n;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/**
+ * Seals the last chunks, writes the index, its tag and the footer, and frees
+ * the writer. The file descriptor is left open.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int container_writer_close(struct container_writer *writer) {
+  unsigned char footer[CONTAINER_FOOTER_SIZE];
+  unsigned char tag[OCB_TAG_SIZE];
+  int result = -1;
+
+  if (writer_flush(writer, 1) == 0) {
+    put_u64(footer, writer->plain_size);
+    put_u32(footer + 8, writer->chunk_count);
+    put_u32(footer + 12, 0);
+    memcpy(footer + 16, container_footer_magic,
+           sizeof(container_footer_magic));
+    if (index_tag(&writer->ctx, writer->header, writer->index,
+                  writer->chunk_count, footer, tag) == 0 &&
+        write_full(writer->fd, writer->index,
+                   writer->chunk_count * CONTAINER_INDEX_ENTRY_SIZE) == 0 &&
+        write_full(writer->fd, tag, OCB_TAG_SIZE) == 0 &&
+        write_full(writer->fd, footer, CONTAINER_FOOTER_SIZE) == 0)
+      result = 0;
+  }
+
+  memset(&writer->ctx, 0, sizeof(writer->ctx));
+  free(writer->buffer);
+  free(writer->sealed);
+  free(writer->index);
+  free(writer);
+  return result;
+}
+
+/**
+ * Checks that the authenticated index describes the chunk layout that
+ * container_read assumes: every chunk but the last is full, the last is not
+ * empty, and the sizes add up to the plain_text size.
+ *
+ * @return 1 if the index is consistent, 0 otherwise.
+ */
+static int index_is_consistent(struct container_reader *reader) {
+  unsigned long long total = 0;
+  unsigned long i;
+
+  for (i = 0; i < reader->chunk_count; i++) {
+    unsigned long len =
+        get_u32(reader->index + i * CONTAINER_INDEX_ENTRY_SIZE + 8);
+    if (len == 0 || len > reader->chunk_size) return 0;
+    if (i + 1 < reader->chunk_count && len != reader->chunk_size) return 0;
+    total += len;
+  }
+  return total == reader->plain_size;
+}
+
+/**
+ * Opens an existing container and verifies its header and index.
+ *
+ * @param fd The file descriptor to read from with pread.
+ * @param key The 16-byte key.
+ * @param nbr_threads The number of threads used to decrypt chunks.
+ * @return The reader, or NULL if the container is invalid.
+ */
+struct container_reader *container_reader_open(int fd, unsigned char *key,
+                                               int nbr_threads) {
+  struct container_reader *reader;
+  unsigned char footer[CONTAINER_FOOTER_SIZE];
+  unsigned char tag[OCB_TAG_SIZE];
+  unsigned char expected[OCB_TAG_SIZE];
+  unsigned long long file_size, index_offset, index_len;
+  off_t end = lseek(fd, 0, SEEK_END);
+  int diff = 0, i;
+
+  if (end < CONTAINER_HEADER_SIZE + OCB_TAG_SIZE + CONTAINER_FOOTER_SIZE)
+    return NULL;
+  file_size = (unsigned long long)end;
+
+  reader = (struct container_reader *)calloc(1, sizeof(*reader));
+  if (reader == NULL) return NULL;
+  reader->fd = fd;
+  reader->nbr_threads = nbr_threads < 1 ? 1 : nbr_threads;
+
+  if (read_full(fd, reader->header, CONTAINER_HEADER_SIZE, 0) != 0 ||
+      read_full(fd, footer, CONTAINER_FOOTER_SIZE,
+                file_size - CONTAINER_FOOTER_SIZE) != 0 ||
+      memcmp(reader->header, container_magic, sizeof(container_magic)) != 0 ||
+      get_u16(reader->header + 4) != CONTAINER_VERSION ||
+      memcmp(footer + 16, container_footer_magic,
+             sizeof(container_footer_magic)) != 0)
+    goto fail;
+
+  reader->chunk_size = (unsigned int)get_u32(reader->header + 8);
+  reader->plain_size = get_u64(footer);
+  reader->chunk_count = get_u32(footer + 8);
+  if (reader->chunk_size == 0 || reader->chunk_size > CONTAINER_MAX_CHUNK_SIZE)
+    goto fail;
+
+  index_len = (unsigned long long)reader->chunk_count *
+              CONTAINER_INDEX_ENTRY_SIZE;
+  if (index_len > file_size - CONTAINER_HEADER_SIZE - OCB_TAG_SIZE -
+                      CONTAINER_FOOTER_SIZE)
+    goto fail;
+  index_offset = file_size - CONTAINER_FOOTER_SIZE - OCB_TAG_SIZE - index_len;
+
+  reader->index = (unsigned char *)malloc(index_len ? index_len : 1);
+  if (reader->index == NULL ||
+      read_full(fd, reader->index, index_len, index_offset) != 0 ||
+      read_full(fd, tag, OCB_TAG_SIZE, index_offset + index_len) != 0)
+    goto fail;
+
+  file_key_init(&reader->ctx, key, reader->header);
+  if (index_tag(&reader->ctx, reader->header, reader->index,
+                reader->chunk_count, footer, expected) != 0)
+    goto fail;
+  for (i = 0; i < OCB_TAG_SIZE; i++) diff |= expected[i] ^ tag[i];
+  if (diff != 0 || !index_is_consistent(reader)) goto fail;
+
+  return reader;
+
+fail:
+  container_reader_close(reader);
+  return NULL;
+}
+
+/**
+ * Returns the plain_text size of the container.
+ */
+unsigned long long container_reader_size(struct container_reader *reader) {
+  return reader->plain_size;
+}
+
+/**
+ * Decrypts a byte range. Only the chunks overlapping the range are read, and
+ * they are decrypted in parallel.
+ *
+ * @param reader The reader.
+ * @param offset The plain_text offset of the first byte wanted.
+ * @param output Where the plain_text is written.
+ * @param len The number of bytes wanted.
+ * @return 0 on success, -1 on error. On error the output is wiped.
+ */
+int container_read(struct container_reader *reader, unsigned long long offset,
+                   unsigned char *output, size_t len) {
+  unsigned long long end = offset + len;
+  unsigned long first, last, c;
+  struct chunk_job *jobs;
+  size_t nbr_jobs, i;
+  int result = 0;
+
+  if (len == 0) return 0;
+  if (end < offset || end > reader->plain_size) return -1;
+
+  first = (unsigned long)(offset / reader->chunk_size);
+  last = (unsigned long)((end - 1) / reader->chunk_size);
+  nbr_jobs = last - first + 1;
+  jobs = (struct chunk_job *)calloc(nbr_jobs, sizeof(*jobs));
+  if (jobs == NULL) return -1;
+
+  for (c = first; c <= last; c++) {
+    struct chunk_job *job = &jobs[c - first];
+    unsigned char *entry = reader->index + c * CONTAINER_INDEX_ENTRY_SIZE;
+    unsigned long long chunk_start = (unsigned long long)c * reader->chunk_size;
+    unsigned long long from = offset > chunk_start ? offset : chunk_start;
+    unsigned long long to = chunk_start + get_u32(entry + 8);
+    if (to > end) to = end;
+
+    job->ctx = &reader->ctx;
+    job->header = reader->header;
+    job->number = c;
+    job->final = c == reader->chunk_count - 1;
+    job->len = get_u32(entry + 8);
+    job->fd = reader->fd;
+    job->file_offset = get_u64(entry);
+    job->copy_from = (size_t)(from - chunk_start);
+    job->copy_len = (size_t)(to - from);
+    job->output = output + (from - offset);
+  }
+  run_jobs(open_chunk, jobs, nbr_jobs, reader->nbr_threads);
+
+  for (i = 0; i < nbr_jobs; i++) {
+    if (jobs[i].result != 0) result = -1;
+  }
+  if (result != 0) memset(output, 0, len);
+  free(jobs);
+  return result;
+}
+
+/**
+ * Frees a reader. The file descriptor is left open.
+ */
+void container_reader_close(struct container_reader *reader) {
+  if (reader == NULL) return;
+  memset(&reader->ctx, 0, sizeof(reader->ctx));
+  free(reader->index);
+  free(reader);
+}
@@ -0,0 +1,71 @@
+/*
+ * Salil Luley - D23124871
+ * This file, container.h, declares a seekable encrypted container format. The
+ * plain_text is split into fixed-size chunks. Each chunk is encrypted and
+ * authenticated on its own with OCB (ocb.h), so a reader can decrypt any byte
+ * range by seeking straight to the chunks that hold it. Reading and writing
+ * both spread the chunks over threads.
+ *
+ * Layout of version 2 (all integers little-endian):
+ *
+ *   header   magic "AESC", u16 version, u16 flags (0), u32 chunk_size,
+ *            u32 reserved (0), 16-byte random salt
+ *   chunks   for each chunk: ciphertext followed by its 16-byte tag
+ *   index    for each chunk: u64 file offset, u32 plain_text length,
+ *            u32 reserved (0)
+ *   tag      16-byte OCB tag over the header, index and footer
+ *   footer   u64 plain_text size, u32 chunk count, u32 reserved (0),
+ *            magic "AESCIDX1"
+ *
+ * Each file has its own OCB key, the salt encrypted under the caller's key,
+ * so a key can be used for any number of files without repeating a nonce.
+ * Chunk i is encrypted under the file key and the nonce u32 big-endian i. Its
+ * associated data is the header, the chunk number as a u64 and one byte that
+ * is 1 for the last chunk. Chunks therefore cannot be reordered, moved between
+ * files or dropped from the end.
+ */
+
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stddef.h>
+
+#define CONTAINER_VERSION 2
+#define CONTAINER_HEADER_SIZE 32
+#define CONTAINER_INDEX_ENTRY_SIZE 16
+#define CONTAINER_FOOTER_SIZE 24
+#define CONTAINER_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+struct container_writer;
+struct container_reader;
+
+/*
+ * Starts a container on fd, which only needs to support write(2), so pipes
+ * work. Returns NULL if the arguments are invalid or memory runs out.
+ */
+struct container_writer *container_writer_open(int fd, unsigned char *key,
+                                               unsigned int chunk_size,
+                                               int nbr_threads);
+int container_writer_write(struct container_writer *writer,
+                           const unsigned char *data, size_t len);
+/* Writes the last chunks, the index and the footer, and frees the writer. */
+int container_writer_close(struct container_writer *writer);
+
+/*
+ * Opens a container on fd, which must support pread(2). The header and index
+ * are read and verified here. Returns NULL if the container is invalid or
+ * does not authenticate under key.
+ */
+struct container_reader *container_reader_open(int fd, unsigned char *key,
+                                               int nbr_threads);
+unsigned long long container_reader_size(struct container_reader *reader);
+/*
+ * Decrypts len bytes starting at plain_text offset into output. Returns 0 on
+ * success and -1 if the range is out of bounds, a read fails or a chunk does
+ * not authenticate.
+ */
+int container_read(struct container_reader *reader, unsigned long long offset,
+                   unsigned char *output, size_t len);
+void container_reader_close(struct container_reader *reader);
+
+#endif
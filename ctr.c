@@ -0,0 +1,227 @@
+/**
+ *  Salil Luley - D23124871
+ * Counter mode over contiguous buffers and iovec lists, with the iovec walker
+ * that GCM builds on.
+ */
+
+#include "ctr.h"
+
+#include <string.h>
+
+/**
+ * The number of counter blocks encrypted per call to the block engine.
+ */
+#define CTR_BATCH_BLOCKS 64
+
+/**
+ * @brief A position inside a list of iovecs.
+ */
+struct iov_cursor {
+  const struct iovec *iov;
+  int count;
+  int index;
+  size_t offset;
+};
+
+/**
+ * Returns how many bytes are left in the cursor's current fragment, moving
+ * past empty or used-up fragments first.
+ */
+static size_t cursor_span(struct iov_cursor *cursor) {
+  while (cursor->index < cursor->count &&
+         cursor->offset == cursor->iov[cursor->index].iov_len) {
+    cursor->index++;
+    cursor->offset = 0;
+  }
+  if (cursor->index == cursor->count) return 0;
+  return cursor->iov[cursor->index].iov_len - cursor->offset;
+}
+
+/**
+ * Returns a pointer to the cursor's position. cursor_span must have been
+ * called first and returned a non-zero length.
+ */
+static unsigned char *cursor_ptr(struct iov_cursor *cursor) {
+  return (unsigned char *)cursor->iov[cursor->index].iov_base + cursor->offset;
+}
+
+/**
+ * Copies len bytes out of the fragments into a contiguous buffer, advancing
+ * the cursor.
+ */
+static void cursor_gather(struct iov_cursor *cursor, unsigned char *dst,
+                          size_t len) {
+  while (len > 0) {
+    size_t n = cursor_span(cursor);
+    if (n > len) n = len;
+    memcpy(dst, cursor_ptr(cursor), n);
+    cursor->offset += n;
+    dst += n;
+    len -= n;
+  }
+}
+
+/**
+ * Copies len bytes from a contiguous buffer into the fragments, advancing the
+ * cursor.
+ */
+static void cursor_scatter(struct iov_cursor *cursor, unsigned char *src,
+                           size_t len) {
+  while (len > 0) {
+    size_t n = cursor_span(cursor);
+    if (n > len) n = len;
+    memcpy(cursor_ptr(cursor), src, n);
+    cursor->offset += n;
+    src += n;
+    len -= n;
+  }
+}
+
+/**
+ * Returns the total length of a list of iovecs.
+ */
+static size_t iov_total(const struct iovec *iov, int count) {
+  size_t total = 0;
+  int i;
+  for (i = 0; i < count; i++) total += iov[i].iov_len;
+  return total;
+}
+
+/**
+ * Increments a big-endian counter block, either all 128 bits or, for GCM,
+ * only the last 32.
+ */
+static void increment_counter(unsigned char *counter, int inc32) {
+  int i;
+  for (i = BLOCK_SIZE - 1; i >= (inc32 ? BLOCK_SIZE - 4 : 0); i--) {
+    if (++counter[i] != 0) break;
+  }
+}
+
+/**
+ * XORs the keystream into a contiguous run, CTR_BATCH_BLOCKS counter blocks
+ * at a time.
+ *
+ * @param expanded_key The key schedule.
+ * @param counter The next counter block, updated in place.
+ * @param inc32 Non-zero to increment only the last 32 bits of the counter.
+ * @param input The input bytes.
+ * @param output The output bytes. May be equal to input.
+ * @param len The number of bytes.
+ */
+static void xor_keystream(unsigned char *expanded_key, unsigned char *counter,
+                          int inc32, unsigned char *input,
+                          unsigned char *output, size_t len) {
+  unsigned char keystream[CTR_BATCH_BLOCKS * BLOCK_SIZE];
+
+  while (len > 0) {
+    size_t nbr_blocks = (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t n, i;
+    if (nbr_blocks > CTR_BATCH_BLOCKS) nbr_blocks = CTR_BATCH_BLOCKS;
+
+    for (i = 0; i < nbr_blocks; i++) {
+      memcpy(keystream + i * BLOCK_SIZE, counter, BLOCK_SIZE);
+      increment_counter(counter, inc32);
+    }
+    aes_encrypt_blocks(keystream, keystream, nbr_blocks, expanded_key);
+
+    n = nbr_blocks * BLOCK_SIZE;
+    if (n > len) n = len;
+    for (i = 0; i < n; i++) output[i] = input[i] ^ keystream[i];
+    input += n;
+    output += n;
+    len -= n;
+  }
+}
+
+/**
+ * Walks the input and output iovecs together, XORing the keystream over the
+ * whole message. Wherever both sides have at least a block in their current
+ * fragments the work is done in place on the fragments; a block that
+ * straddles a fragment boundary on either side goes through a temporary.
+ *
+ * @return 0 on success, -1 if the output is shorter than the input.
+ */
+int ctr_xor_iov(unsigned char *expanded_key, unsigned char *counter, int inc32,
+                const struct iovec *input, int input_count,
+                const struct iovec *output, int output_count,
+                ctr_span_fn before, ctr_span_fn after, void *arg) {
+  struct iov_cursor in = {input, input_count, 0, 0};
+  struct iov_cursor out = {output, output_count, 0, 0};
+  size_t remaining = iov_total(input, input_count);
+  unsigned char block[BLOCK_SIZE];
+
+  if (iov_total(output, output_count) < remaining) return -1;
+
+  while (remaining > 0) {
+    size_t in_span = cursor_span(&in);
+    size_t out_span = cursor_span(&out);
+    size_t n = in_span < out_span ? in_span : out_span;
+    if (n > remaining) n = remaining;
+
+    if (n == remaining || n >= BLOCK_SIZE) {
+      unsigned char *src = cursor_ptr(&in);
+      unsigned char *dst = cursor_ptr(&out);
+      if (n != remaining) n -= n % BLOCK_SIZE;
+      if (before != NULL) before(arg, src, n);
+      xor_keystream(expanded_key, counter, inc32, src, dst, n);
+      if (after != NULL) after(arg, dst, n);
+      in.offset += n;
+      out.offset += n;
+    } else {
+      n = remaining < BLOCK_SIZE ? remaining : BLOCK_SIZE;
+      cursor_gather(&in, block, n);
+      if (before != NULL) before(arg, block, n);
+      xor_keystream(expanded_key, counter, inc32, block, block, n);
+      if (after != NULL) after(arg, block, n);
+      cursor_scatter(&out, block, n);
+    }
+    remaining -= n;
+  }
+  return 0;
+}
+
+/**
+ * Prepares a context for use with the given key.
+ *
+ * @param ctx The context to initialise.
+ * @param key The 16-byte key.
+ */
+void ctr_init(struct ctr_context *ctx, unsigned char *key) {
+  expand_key(ctx->expanded_key, key);
+}
+
+/**
+ * Encrypts or decrypts a scatter-gather list into another one.
+ *
+ * @param ctx The context.
+ * @param counter The 16-byte counter block, updated in place.
+ * @param input The input fragments.
+ * @param input_count The number of input fragments.
+ * @param output The output fragments. May be the same list as input.
+ * @param output_count The number of output fragments.
+ * @return 0 on success, -1 if the output is shorter than the input.
+ */
+int ctr_crypt_iov(struct ctr_context *ctx, unsigned char *counter,
+                  const struct iovec *input, int input_count,
+                  const struct iovec *output, int output_count) {
+  return ctr_xor_iov(ctx->expanded_key, counter, 0, input, input_count, output,
+                     output_count, NULL, NULL, NULL);
+}
+
+/**
+ * Encrypts or decrypts a contiguous buffer, as a list of one iovec.
+ *
+ * @param ctx The context.
+ * @param counter The 16-byte counter block, updated in place.
+ * @param input The input bytes.
+ * @param output The output bytes. May be equal to input.
+ * @param len The number of bytes.
+ * @return Always 0.
+ */
+int ctr_crypt(struct ctr_context *ctx, unsigned char *counter,
+              unsigned char *input, unsigned char *output, size_t len) {
+  struct iovec in = {input, len};
+  struct iovec out = {output, len};
+  return ctr_crypt_iov(ctx, counter, &in, 1, &out, 1);
+}
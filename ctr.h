@@ -0,0 +1,52 @@
+/*
+ * Salil Luley - D23124871
+ * This file, ctr.h, declares counter (CTR) mode on top of the AES-128 block
+ * functions in rijndael.h, for contiguous buffers and for scatter-gather
+ * lists (struct iovec). With iovecs the input and output can be split into
+ * fragments at any byte positions. A block that straddles fragments is handled
+ * through a 16-byte temporary; everything else is encrypted straight from the
+ * input fragment into the output fragment. The counter is a 16-byte big-endian
+ * number that is incremented once per block, including a final partial block.
+ */
+
+#ifndef CTR_H
+#define CTR_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "rijndael.h"
+
+struct ctr_context {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+};
+
+void ctr_init(struct ctr_context *ctx, unsigned char *key);
+
+/*
+ * Encryption and decryption are the same operation. counter is updated to the
+ * next unused value. Returns 0 on success and -1 if the output iovecs are
+ * shorter than the input.
+ */
+int ctr_crypt(struct ctr_context *ctx, unsigned char *counter,
+              unsigned char *input, unsigned char *output, size_t len);
+int ctr_crypt_iov(struct ctr_context *ctx, unsigned char *counter,
+                  const struct iovec *input, int input_count,
+                  const struct iovec *output, int output_count);
+
+/*
+ * The walker shared with GCM. Runs the keystream over the input and writes
+ * the output. The callbacks, if given, see the message in order as
+ * contiguous spans that start on block boundaries. before sees the input
+ * before it is XORed, and after sees the output. Only the last span can be
+ * shorter than a block. inc32 selects the GCM counter, which only increments
+ * its last 32 bits.
+ */
+typedef void (*ctr_span_fn)(void *arg, unsigned char *data, size_t len);
+
+int ctr_xor_iov(unsigned char *expanded_key, unsigned char *counter, int inc32,
+                const struct iovec *input, int input_count,
+                const struct iovec *output, int output_count,
+                ctr_span_fn before, ctr_span_fn after, void *arg);
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ *  Salil Luley - D23124871
+ * Galois/Counter Mode built from the CTR iovec walker and a table-driven
+ * GHASH.
+ */
+
+#include "gcm.h"
+
+#include <string.h>
+
+#include "ctr.h"
+
+/**
+ * Reduction constants for shifting the product right by four bits, indexed by
+ * the four bits shifted out.
+ */
+static const unsigned long long gcm_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+/**
+ * @brief The running GHASH value of one message.
+ */
+struct ghash_state {
+  struct gcm_context *ctx;
+  unsigned char x[BLOCK_SIZE];
+};
+
+static unsigned long long get_be64(const unsigned char *p) {
+  unsigned long long v = 0;
+  int i;
+  for (i = 0; i < 8; i++) v = (v << 8) | p[i];
+  return v;
+}
+
+static void put_be64(unsigned char *p, unsigned long long v) {
+  int i;
+  for (i = 7; i >= 0; i--) {
+    p[i] = (unsigned char)v;
+    v >>= 8;
+  }
+}
+
+/**
+ * Prepares a context for use with the given key: expands the key, computes
+ * H = E(0) and fills the tables of the multiples of H by every 4-bit value.
+ *
+ * @param ctx The context to initialise.
+ * @param key The 16-byte key.
+ */
+void gcm_init(struct gcm_context *ctx, unsigned char *key) {
+  unsigned char h[BLOCK_SIZE] = {0};
+  unsigned long long vh, vl;
+  int i, j;
+
+  expand_key(ctx->expanded_key, key);
+  aes_encrypt_blocks(h, h, 1, ctx->expanded_key);
+  vh = get_be64(h);
+  vl = get_be64(h + 8);
+
+  ctx->hh[8] = vh;
+  ctx->hl[8] = vl;
+  for (i = 4; i > 0; i >>= 1) {
+    unsigned long long t = (vl & 1) ? 0xe1000000ULL : 0;
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ (t << 32);
+    ctx->hh[i] = vh;
+    ctx->hl[i] = vl;
+  }
+  ctx->hh[0] = 0;
+  ctx->hl[0] = 0;
+  for (i = 2; i <= 8; i *= 2) {
+    for (j = 1; j < i; j++) {
+      ctx->hh[i + j] = ctx->hh[i] ^ ctx->hh[j];
+      ctx->hl[i + j] = ctx->hl[i] ^ ctx->hl[j];
+    }
+  }
+}
+
+/**
+ * Multiplies a block by H in GF(2^128), four bits at a time.
+ *
+ * @param ctx The context holding the tables for H.
+ * @param x The block, replaced by the product.
+ */
+static void gcm_mult(struct gcm_context *ctx, unsigned char *x) {
+  unsigned long long zh, zl;
+  unsigned char lo, hi, rem;
+  int i;
+
+  lo = x[15] & 0xf;
+  zh = ctx->hh[lo];
+  zl = ctx->hl[lo];
+
+  for (i = 15; i >= 0; i--) {
+    lo = x[i] & 0xf;
+    hi = (x[i] >> 4) & 0xf;
+    if (i != 15) {
+      rem = (unsigned char)(zl & 0xf);
+      zl = (zh << 60) | (zl >> 4);
+      zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+      zh ^= ctx->hh[lo];
+      zl ^= ctx->hl[lo];
+    }
+    rem = (unsigned char)(zl & 0xf);
+    zl = (zh << 60) | (zl >> 4);
+    zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+    zh ^= ctx->hh[hi];
+    zl ^= ctx->hl[hi];
+  }
+  put_be64(x, zh);
+  put_be64(x + 8, zl);
+}
+
+/**
+ * Feeds data into GHASH. A trailing partial block is padded with zeros, so
+ * every call but the last for a given input must be a whole number of blocks.
+ */
+static void ghash_update(struct ghash_state *g, unsigned char *data,
+                         size_t len) {
+  while (len > 0) {
+    size_t n = len < BLOCK_SIZE ? len : BLOCK_SIZE;
+    size_t i;
+    for (i = 0; i < n; i++) g->x[i] ^= data[i];
+    gcm_mult(g->ctx, g->x);
+    data += n;
+    len -= n;
+  }
+}
+
+/**
+ * Callback for ctr_xor_iov that hashes each span of ciphertext.
+ */
+static void ghash_span(void *arg, unsigned char *data, size_t len) {
+  ghash_update((struct ghash_state *)arg, data, len);
+}
+
+/**
+ * The common body of the GCM entry points: derives the pre-counter block,
+ * runs the walker with GHASH on the ciphertext side and computes the tag.
+ *
+ * @return 0 on success, -1 on bad arguments.
+ */
+static int gcm_crypt_iov(struct gcm_context *ctx, unsigned char *iv,
+                         size_t iv_len, unsigned char *ad, size_t ad_len,
+                         const struct iovec *input, int input_count,
+                         const struct iovec *output, int output_count,
+                         unsigned char *tag, int decrypt) {
+  struct ghash_state g;
+  unsigned char j0[BLOCK_SIZE];
+  unsigned char counter[BLOCK_SIZE];
+  unsigned char lengths[BLOCK_SIZE];
+  unsigned long long len = 0;
+  int i;
+
+  for (i = 0; i < input_count; i++) len += input[i].iov_len;
+  if (iv_len == 0 || len > GCM_MAX_LEN) return -1;
+
+  g.ctx = ctx;
+  memset(g.x, 0, BLOCK_SIZE);
+  if (iv_len == 12) {
+    memcpy(j0, iv, 12);
+    j0[12] = 0;
+    j0[13] = 0;
+    j0[14] = 0;
+    j0[15] = 1;
+  } else {
+    ghash_update(&g, iv, iv_len);
+    put_be64(lengths, 0);
+    put_be64(lengths + 8, (unsigned long long)iv_len * 8);
+    ghash_update(&g, lengths, BLOCK_SIZE);
+    memcpy(j0, g.x, BLOCK_SIZE);
+    memset(g.x, 0, BLOCK_SIZE);
+  }
+
+  memcpy(counter, j0, BLOCK_SIZE);
+  for (i = BLOCK_SIZE - 1; i >= BLOCK_SIZE - 4; i--) {
+    if (++counter[i] != 0) break;
+  }
+
+  if (ad_len > 0) ghash_update(&g, ad, ad_len);
+  if (ctr_xor_iov(ctx->expanded_key, counter, 1, input, input_count, output,
+                  output_count, decrypt ? ghash_span : NULL,
+                  decrypt ? NULL : ghash_span, &g) != 0)
+    return -1;
+
+  put_be64(lengths, (unsigned long long)ad_len * 8);
+  put_be64(lengths + 8, len * 8);
+  ghash_update(&g, lengths, BLOCK_SIZE);
+
+  aes_encrypt_blocks(j0, tag, 1, ctx->expanded_key);
+  for (i = 0; i < GCM_TAG_SIZE; i++) tag[i] ^= g.x[i];
+  return 0;
+}
+
+/**
+ * Encrypts and authenticates a scatter-gather list.
+ *
+ * @param ctx The context initialised with gcm_init.
+ * @param iv The IV, unique per message under a key.
+ * @param iv_len The length of the IV in bytes.
+ * @param ad Associated data that is authenticated but not encrypted.
+ * @param ad_len The length of the associated data in bytes.
+ * @param input The plain_text fragments.
+ * @param input_count The number of plain_text fragments.
+ * @param output The ciphertext fragments. May be the same list as input.
+ * @param output_count The number of ciphertext fragments.
+ * @param tag Where the 16-byte tag is written.
+ * @return 0 on success, -1 on bad arguments.
+ */
+int gcm_encrypt_iov(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                    unsigned char *ad, size_t ad_len,
+                    const struct iovec *input, int input_count,
+                    const struct iovec *output, int output_count,
+                    unsigned char *tag) {
+  return gcm_crypt_iov(ctx, iv, iv_len, ad, ad_len, input, input_count, output,
+                       output_count, tag, 0);
+}
+
+/**
+ * Decrypts a scatter-gather list and verifies its tag.
+ *
+ * @param ctx The context initialised with gcm_init.
+ * @param iv The IV used for encryption.
+ * @param iv_len The length of the IV in bytes.
+ * @param ad The associated data used for encryption.
+ * @param ad_len The length of the associated data in bytes.
+ * @param input The ciphertext fragments.
+ * @param input_count The number of ciphertext fragments.
+ * @param tag The 16-byte tag that came with the ciphertext.
+ * @param output The plain_text fragments. May be the same list as input.
+ * @param output_count The number of plain_text fragments.
+ * @return 0 if the tag verifies, -1 otherwise.
+ */
+int gcm_decrypt_iov(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                    unsigned char *ad, size_t ad_len,
+                    const struct iovec *input, int input_count,
+                    unsigned char *tag, const struct iovec *output,
+                    int output_count) {
+  unsigned char expected[GCM_TAG_SIZE];
+  unsigned char diff = 0;
+  size_t len = 0;
+  int i;
+
+  if (gcm_crypt_iov(ctx, iv, iv_len, ad, ad_len, input, input_count, output,
+                    output_count, expected, 1) != 0)
+    return -1;
+  for (i = 0; i < GCM_TAG_SIZE; i++) diff |= expected[i] ^ tag[i];
+  if (diff == 0) return 0;
+
+  for (i = 0; i < input_count; i++) len += input[i].iov_len;
+  for (i = 0; i < output_count && len > 0; i++) {
+    size_t n = output[i].iov_len < len ? output[i].iov_len : len;
+    memset(output[i].iov_base, 0, n);
+    len -= n;
+  }
+  return -1;
+}
+
+/**
+ * Encrypts and authenticates a contiguous buffer.
+ *
+ * @return 0 on success, -1 on bad arguments.
+ */
+int gcm_encrypt(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                unsigned char *ad, size_t ad_len, unsigned char *plain_text,
+                size_t len, unsigned char *output, unsigned char *tag) {
+  struct iovec in = {plain_text, len};
+  struct iovec out = {output, len};
+  return gcm_encrypt_iov(ctx, iv, iv_len, ad, ad_len, &in, 1, &out, 1, tag);
+}
+
+/**
+ * Decrypts a contiguous buffer and verifies its tag.
+ *
+ * @return 0 if the tag verifies, -1 otherwise.
+ */
+int gcm_decrypt(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                unsigned char *ad, size_t ad_len, unsigned char *ciphertext,
+                size_t len, unsigned char *tag, unsigned char *output) {
+  struct iovec in = {ciphertext, len};
+  struct iovec out = {output, len};
+  return gcm_decrypt_iov(ctx, iv, iv_len, ad, ad_len, &in, 1, tag, &out, 1);
+}
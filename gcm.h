@@ -0,0 +1,53 @@
+/*
+ * Salil Luley - D23124871
+ * This file, gcm.h, declares Galois/Counter Mode (NIST SP 800-38D) on top of
+ * the AES-128 block functions in rijndael.h. Encryption is the CTR walker from
+ * ctr.h with a 32-bit counter, and authentication is GHASH over the
+ * associated data and ciphertext. The gcm_context keeps the expanded key and
+ * a 4-bit multiplication table for the hash key H. Like CTR, both entry points
+ * accept scatter-gather lists. Tags are always 128 bits.
+ */
+
+#ifndef GCM_H
+#define GCM_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "rijndael.h"
+
+#define GCM_TAG_SIZE 16
+/* The largest message GCM allows under one key and IV: 2^32 - 2 blocks. */
+#define GCM_MAX_LEN ((1ULL << 36) - 32)
+
+struct gcm_context {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned long long hl[16];
+  unsigned long long hh[16];
+};
+
+void gcm_init(struct gcm_context *ctx, unsigned char *key);
+
+/*
+ * All functions return 0 on success and -1 on bad arguments. Decryption also
+ * returns -1 when the tag does not verify, in which case the output is wiped.
+ * The iv must not be empty; 12 bytes is the usual and fastest length.
+ */
+int gcm_encrypt(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                unsigned char *ad, size_t ad_len, unsigned char *plain_text,
+                size_t len, unsigned char *output, unsigned char *tag);
+int gcm_decrypt(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                unsigned char *ad, size_t ad_len, unsigned char *ciphertext,
+                size_t len, unsigned char *tag, unsigned char *output);
+int gcm_encrypt_iov(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                    unsigned char *ad, size_t ad_len,
+                    const struct iovec *input, int input_count,
+                    const struct iovec *output, int output_count,
+                    unsigned char *tag);
+int gcm_decrypt_iov(struct gcm_context *ctx, unsigned char *iv, size_t iv_len,
+                    unsigned char *ad, size_t ad_len,
+                    const struct iovec *input, int input_count,
+                    unsigned char *tag, const struct iovec *output,
+                    int output_count);
+
+#endif
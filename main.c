@@ -2,9 +2,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "perf.h"
 #include "rijndael.h"
 
+/**
+ * Number of blocks each kernel runs over in profiling mode.
+ */
+#define PROFILE_BLOCKS 8192
+
 /**
  * @brief Enumeration representing different key sizes.
  *
@@ -32,6 +40,63 @@ void print_128bit_block(unsigned char *block) {
   }
 }
 
+/**
+ * Returns a monotonic timestamp in seconds.
+ */
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs aes_main, aes_inv_main and expand_key over PROFILE_BLOCKS blocks each
+ * and prints their time and hardware counters per block and per byte. Falls
+ * back to time only when perf events are unavailable.
+ *
+ * @param key The key to expand for the round kernels.
+ * @return 0 on success, 1 if the buffer cannot be allocated.
+ */
+int profile_kernels(unsigned char *key) {
+  static const char *names[3] = {"aes_main", "aes_inv_main", "expand_key"};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char scratch[EXPANDED_KEY_SIZE];
+  unsigned char *buffer = malloc(PROFILE_BLOCKS * BLOCK_SIZE);
+  struct perf_counters counters;
+  struct perf_reading reading;
+  double start;
+
+  if (buffer == NULL) return 1;
+  for (int i = 0; i < PROFILE_BLOCKS * BLOCK_SIZE; i++)
+    buffer[i] = (unsigned char)i;
+  expand_key(expanded_key, key);
+  if (perf_open(&counters) == 0)
+    printf("perf events unavailable (%s), reporting time only\n",
+           strerror(counters.error));
+
+  for (int kernel = 0; kernel < 3; kernel++) {
+    perf_start(&counters);
+    start = now_seconds();
+    for (int i = 0; i < PROFILE_BLOCKS; i++) {
+      unsigned char *block = buffer + i * BLOCK_SIZE;
+      if (kernel == 0)
+        aes_main(block, expanded_key, NBR_ROUNDS);
+      else if (kernel == 1)
+        aes_inv_main(block, expanded_key, NBR_ROUNDS);
+      else
+        expand_key(scratch, block);
+    }
+    perf_stop(&counters, &reading);
+    perf_report(names[kernel], counters.nbr_open > 0 ? &reading : NULL,
+                now_seconds() - start,
+                (unsigned long long)PROFILE_BLOCKS * BLOCK_SIZE);
+  }
+
+  perf_close(&counters);
+  free(buffer);
+  return 0;
+}
+
 /**
  * @file main.c
  * @brief This file contains the main function for performing AES encryption and
@@ -40,9 +105,10 @@ void print_128bit_block(unsigned char *block) {
 
 /**
  * @brief The main function for performing AES encryption and decryption.
+ * With --profile it profiles the cipher kernels instead.
  * @return 0 on successful execution.
  */
-int main() {
+int main(int argc, char **argv) {
   // Initialize variables
   int expanded_key_size = 176;
   unsigned char expanded_key[expanded_key_size];
@@ -55,6 +121,9 @@ int main() {
   unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
                            75, 17, 51, 17, 4,  8, 6,  99};
 
+  if (argc > 1 && strcmp(argv[1], "--profile") == 0)
+    return profile_kernels(key);
+
   // Perform AES encryption and decryption
   unsigned char *ciphertext = aes_encrypt_block(plain_text, key);
   unsigned char *recovered_plaintext = aes_decrypt_block(ciphertext, key);
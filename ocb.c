@@ -0,0 +1,464 @@
+/**
+ *  Salil Luley - D23124871
+ * OCB3 authenticated encryption (RFC 7253) on top of the AES-128 multi-block
+ * engine in rijndael.c, with a multi-threaded variant for large buffers.
+ */
+
+#include "ocb.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * The number of blocks handed to the block engine per iteration of the bulk
+ * loop. Matches the lane count of aes_encrypt_blocks.
+ */
+#define OCB_LANES 4
+
+/**
+ * Below this many full blocks the cost of starting threads outweighs the work
+ * they would share, so the multi-threaded entry points stay single-threaded.
+ */
+#define OCB_MT_MIN_BLOCKS 1024
+
+/**
+ * Upper bound on the threads a single call will start.
+ */
+#define OCB_MAX_THREADS 64
+
+/**
+ * The state of one slice of the full blocks, processed by one thread.
+ */
+struct ocb_job {
+  struct ocb_context *ctx;
+  unsigned char offset[BLOCK_SIZE];
+  unsigned long long index;
+  unsigned char *input;
+  unsigned char *output;
+  size_t nbr_blocks;
+  unsigned char checksum[BLOCK_SIZE];
+  int decrypt;
+};
+
+/**
+ * XORs two 16-byte blocks.
+ *
+ * @param dst Where the result is written. May be equal to a or b.
+ * @param a The first block.
+ * @param b The second block.
+ */
+static void xor_block(unsigned char *dst, unsigned char *a, unsigned char *b) {
+  int i;
+  for (i = 0; i < BLOCK_SIZE; i++) dst[i] = a[i] ^ b[i];
+}
+
+/**
+ * Multiplies a block by x in GF(2^128), the "double" operation of RFC 7253.
+ *
+ * @param out The doubled block.
+ * @param in The block to double.
+ */
+static void double_block(unsigned char *out, unsigned char *in) {
+  unsigned char carry = in[0] >> 7;
+  int i;
+  for (i = 0; i < BLOCK_SIZE - 1; i++)
+    out[i] = (unsigned char)((in[i] << 1) | (in[i + 1] >> 7));
+  out[BLOCK_SIZE - 1] = (unsigned char)((in[BLOCK_SIZE - 1] << 1) ^
+                                        (carry ? 0x87 : 0x00));
+}
+
+/**
+ * Counts the trailing zero bits of a non-zero block number.
+ *
+ * @param i The block number.
+ * @return The number of trailing zeros.
+ */
+static int ntz(unsigned long long i) {
+  int n = 0;
+  while ((i & 1) == 0) {
+    i >>= 1;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * Prepares a context for use with the given key: expands the key and
+ * precomputes L_*, L_$ and the L table.
+ *
+ * @param ctx The context to initialise.
+ * @param key The 16-byte key.
+ */
+void ocb_init(struct ocb_context *ctx, unsigned char *key) {
+  unsigned char zero[BLOCK_SIZE] = {0};
+  int i;
+
+  expand_key(ctx->expanded_key, key);
+  aes_encrypt_blocks(zero, ctx->l_star, 1, ctx->expanded_key);
+  double_block(ctx->l_dollar, ctx->l_star);
+  double_block(ctx->l[0], ctx->l_dollar);
+  for (i = 1; i < OCB_L_TABLE_SIZE; i++) double_block(ctx->l[i], ctx->l[i - 1]);
+}
+
+/**
+ * Derives Offset_0 from the nonce.
+ *
+ * @param ctx The context.
+ * @param nonce The nonce.
+ * @param nonce_len The length of the nonce in bytes, at most 15.
+ * @param offset Where Offset_0 is written.
+ */
+static void ocb_initial_offset(struct ocb_context *ctx, unsigned char *nonce,
+                               size_t nonce_len, unsigned char *offset) {
+  unsigned char nonce_block[BLOCK_SIZE] = {0};
+  unsigned char ktop[BLOCK_SIZE];
+  unsigned char stretch[BLOCK_SIZE + 8];
+  int bottom, byte_shift, bit_shift, i;
+
+  // The tag length is 128 bits, so the leading TAGLEN mod 128 field is zero.
+  if (nonce_len > 0)
+    memcpy(nonce_block + BLOCK_SIZE - nonce_len, nonce, nonce_len);
+  nonce_block[BLOCK_SIZE - 1 - nonce_len] |= 0x01;
+  bottom = nonce_block[BLOCK_SIZE - 1] & 0x3f;
+  nonce_block[BLOCK_SIZE - 1] &= 0xc0;
+
+  aes_encrypt_blocks(nonce_block, ktop, 1, ctx->expanded_key);
+  memcpy(stretch, ktop, BLOCK_SIZE);
+  for (i = 0; i < 8; i++) stretch[BLOCK_SIZE + i] = ktop[i] ^ ktop[i + 1];
+
+  byte_shift = bottom / 8;
+  bit_shift = bottom % 8;
+  for (i = 0; i < BLOCK_SIZE; i++) {
+    offset[i] = (unsigned char)(stretch[i + byte_shift] << bit_shift);
+    if (bit_shift)
+      offset[i] |= stretch[i + byte_shift + 1] >> (8 - bit_shift);
+  }
+}
+
+/**
+ * Computes Offset_i directly from Offset_0. Walking the offsets one block at a
+ * time XORs L[ntz(j)] for every j up to i, which leaves exactly the L entries
+ * selected by the bits of the Gray code of i.
+ *
+ * @param ctx The context.
+ * @param offset0 Offset_0.
+ * @param index The block number i.
+ * @param offset Where Offset_i is written.
+ */
+static void ocb_offset_at(struct ocb_context *ctx, unsigned char *offset0,
+                          unsigned long long index, unsigned char *offset) {
+  unsigned long long gray = index ^ (index >> 1);
+  int k;
+
+  memcpy(offset, offset0, BLOCK_SIZE);
+  for (k = 0; gray != 0; k++, gray >>= 1) {
+    if (gray & 1) xor_block(offset, offset, ctx->l[k]);
+  }
+}
+
+/**
+ * Encrypts or decrypts a run of full blocks, OCB_LANES at a time.
+ *
+ * @param ctx The context.
+ * @param offset On entry Offset_index, on return the offset of the last block.
+ * @param index The number of blocks that precede this run in the message.
+ * @param input The input blocks.
+ * @param output The output blocks. May be equal to input.
+ * @param nbr_blocks The number of blocks in the run.
+ * @param checksum The plain_text checksum, updated in place.
+ * @param decrypt Non-zero to decrypt, zero to encrypt.
+ */
+static void ocb_crypt_blocks(struct ocb_context *ctx, unsigned char *offset,
+                             unsigned long long index, unsigned char *input,
+                             unsigned char *output, size_t nbr_blocks,
+                             unsigned char *checksum, int decrypt) {
+  unsigned char offsets[OCB_LANES][BLOCK_SIZE];
+  unsigned char buf[OCB_LANES * BLOCK_SIZE];
+  size_t done = 0;
+  int lanes, lane;
+
+  while (done < nbr_blocks) {
+    lanes = (nbr_blocks - done < OCB_LANES) ? (int)(nbr_blocks - done)
+                                            : OCB_LANES;
+    for (lane = 0; lane < lanes; lane++) {
+      unsigned char *in = input + (done + lane) * BLOCK_SIZE;
+      xor_block(offset, offset, ctx->l[ntz(++index)]);
+      memcpy(offsets[lane], offset, BLOCK_SIZE);
+      if (!decrypt) xor_block(checksum, checksum, in);
+      xor_block(buf + lane * BLOCK_SIZE, in, offset);
+    }
+
+    if (decrypt)
+      aes_decrypt_blocks(buf, buf, lanes, ctx->expanded_key);
+    else
+      aes_encrypt_blocks(buf, buf, lanes, ctx->expanded_key);
+
+    for (lane = 0; lane < lanes; lane++) {
+      unsigned char *out = output + (done + lane) * BLOCK_SIZE;
+      xor_block(out, buf + lane * BLOCK_SIZE, offsets[lane]);
+      if (decrypt) xor_block(checksum, checksum, out);
+    }
+    done += lanes;
+  }
+}
+
+/**
+ * Thread entry point for one slice of the full blocks.
+ *
+ * @param arg The ocb_job describing the slice.
+ * @return Always NULL.
+ */
+static void *ocb_worker(void *arg) {
+  struct ocb_job *job = (struct ocb_job *)arg;
+  ocb_crypt_blocks(job->ctx, job->offset, job->index, job->input, job->output,
+                   job->nbr_blocks, job->checksum, job->decrypt);
+  return NULL;
+}
+
+/**
+ * Processes the full blocks on several threads. Each thread derives its own
+ * starting offset and keeps its own checksum; the checksums are combined
+ * afterwards since the checksum is a plain XOR.
+ *
+ * @param ctx The context.
+ * @param offset On entry Offset_0, on return the offset of the last block.
+ * @param input The input blocks.
+ * @param output The output blocks.
+ * @param nbr_blocks The number of full blocks.
+ * @param checksum The plain_text checksum, updated in place.
+ * @param decrypt Non-zero to decrypt, zero to encrypt.
+ * @param nbr_threads The number of threads to use.
+ */
+static void ocb_crypt_blocks_mt(struct ocb_context *ctx, unsigned char *offset,
+                                unsigned char *input, unsigned char *output,
+                                size_t nbr_blocks, unsigned char *checksum,
+                                int decrypt, int nbr_threads) {
+  struct ocb_job jobs[OCB_MAX_THREADS];
+  pthread_t threads[OCB_MAX_THREADS];
+  int started[OCB_MAX_THREADS] = {0};
+  size_t per_thread, start = 0;
+  int t;
+
+  if (nbr_threads > OCB_MAX_THREADS) nbr_threads = OCB_MAX_THREADS;
+  per_thread = (nbr_blocks / nbr_threads) & ~(size_t)(OCB_LANES - 1);
+
+  for (t = 0; t < nbr_threads; t++) {
+    struct ocb_job *job = &jobs[t];
+    job->ctx = ctx;
+    job->index = start;
+    job->input = input + start * BLOCK_SIZE;
+    job->output = output + start * BLOCK_SIZE;
+    job->nbr_blocks = (t == nbr_threads - 1) ? nbr_blocks - start : per_thread;
+    job->decrypt = decrypt;
+    memset(job->checksum, 0, BLOCK_SIZE);
+    ocb_offset_at(ctx, offset, start, job->offset);
+    start += job->nbr_blocks;
+  }
+
+  // The calling thread takes the first slice itself.
+  for (t = 1; t < nbr_threads; t++)
+    started[t] = pthread_create(&threads[t], NULL, ocb_worker, &jobs[t]) == 0;
+  ocb_worker(&jobs[0]);
+
+  for (t = 1; t < nbr_threads; t++) {
+    if (started[t])
+      pthread_join(threads[t], NULL);
+    else
+      ocb_worker(&jobs[t]);
+  }
+
+  for (t = 0; t < nbr_threads; t++)
+    xor_block(checksum, checksum, jobs[t].checksum);
+  memcpy(offset, jobs[nbr_threads - 1].offset, BLOCK_SIZE);
+}
+
+/**
+ * Computes HASH(K, A) over the associated data.
+ *
+ * @param ctx The context.
+ * @param ad The associated data.
+ * @param ad_len The length of the associated data in bytes.
+ * @param sum Where the 16-byte result is written.
+ */
+static void ocb_hash(struct ocb_context *ctx, unsigned char *ad, size_t ad_len,
+                     unsigned char *sum) {
+  unsigned char offset[BLOCK_SIZE] = {0};
+  unsigned char buf[BLOCK_SIZE];
+  size_t full = ad_len / BLOCK_SIZE;
+  size_t rem = ad_len % BLOCK_SIZE;
+  size_t i;
+
+  memset(sum, 0, BLOCK_SIZE);
+  for (i = 0; i < full; i++) {
+    xor_block(offset, offset, ctx->l[ntz(i + 1)]);
+    xor_block(buf, ad + i * BLOCK_SIZE, offset);
+    aes_encrypt_blocks(buf, buf, 1, ctx->expanded_key);
+    xor_block(sum, sum, buf);
+  }
+
+  if (rem > 0) {
+    xor_block(offset, offset, ctx->l_star);
+    memset(buf, 0, BLOCK_SIZE);
+    memcpy(buf, ad + full * BLOCK_SIZE, rem);
+    buf[rem] = 0x80;
+    xor_block(buf, buf, offset);
+    aes_encrypt_blocks(buf, buf, 1, ctx->expanded_key);
+    xor_block(sum, sum, buf);
+  }
+}
+
+/**
+ * The common body of all OCB entry points.
+ *
+ * @param ctx The context.
+ * @param nonce The nonce.
+ * @param nonce_len The length of the nonce in bytes.
+ * @param ad The associated data.
+ * @param ad_len The length of the associated data in bytes.
+ * @param input The plain_text or ciphertext.
+ * @param len The length of the input in bytes.
+ * @param output Where the result is written. May be equal to input.
+ * @param tag Where the 16-byte tag is written.
+ * @param decrypt Non-zero to decrypt, zero to encrypt.
+ * @param nbr_threads The number of threads to use for the full blocks.
+ * @return 0 on success, -1 on bad arguments.
+ */
+static int ocb_crypt(struct ocb_context *ctx, unsigned char *nonce,
+                     size_t nonce_len, unsigned char *ad, size_t ad_len,
+                     unsigned char *input, size_t len, unsigned char *output,
+                     unsigned char *tag, int decrypt, int nbr_threads) {
+  unsigned char offset[BLOCK_SIZE];
+  unsigned char checksum[BLOCK_SIZE] = {0};
+  unsigned char pad[BLOCK_SIZE];
+  unsigned char hash[BLOCK_SIZE];
+  size_t full = len / BLOCK_SIZE;
+  size_t rem = len % BLOCK_SIZE;
+  size_t i;
+
+  if (nonce_len > OCB_MAX_NONCE_SIZE) return -1;
+  if ((unsigned long long)full >> OCB_L_TABLE_SIZE ||
+      (unsigned long long)(ad_len / BLOCK_SIZE) >> OCB_L_TABLE_SIZE)
+    return -1;
+
+  ocb_initial_offset(ctx, nonce, nonce_len, offset);
+
+  if (nbr_threads > 1 && full >= OCB_MT_MIN_BLOCKS)
+    ocb_crypt_blocks_mt(ctx, offset, input, output, full, checksum, decrypt,
+                        nbr_threads);
+  else
+    ocb_crypt_blocks(ctx, offset, 0, input, output, full, checksum, decrypt);
+
+  if (rem > 0) {
+    unsigned char *in = input + full * BLOCK_SIZE;
+    unsigned char *out = output + full * BLOCK_SIZE;
+    xor_block(offset, offset, ctx->l_star);
+    aes_encrypt_blocks(offset, pad, 1, ctx->expanded_key);
+    for (i = 0; i < rem; i++) {
+      unsigned char c = in[i] ^ pad[i];
+      checksum[i] ^= decrypt ? c : in[i];
+      out[i] = c;
+    }
+    checksum[rem] ^= 0x80;
+  }
+
+  xor_block(checksum, checksum, offset);
+  xor_block(checksum, checksum, ctx->l_dollar);
+  aes_encrypt_blocks(checksum, tag, 1, ctx->expanded_key);
+  ocb_hash(ctx, ad, ad_len, hash);
+  xor_block(tag, tag, hash);
+  return 0;
+}
+
+/**
+ * Checks a received tag against the computed one without an early exit.
+ *
+ * @param expected The computed tag.
+ * @param received The tag that came with the ciphertext.
+ * @return 1 if the tags are equal, 0 otherwise.
+ */
+static int ocb_tag_matches(unsigned char *expected, unsigned char *received) {
+  unsigned char diff = 0;
+  int i;
+  for (i = 0; i < OCB_TAG_SIZE; i++) diff |= expected[i] ^ received[i];
+  return diff == 0;
+}
+
+/**
+ * Encrypts and authenticates a message.
+ *
+ * @param ctx The context initialised with ocb_init.
+ * @param nonce The nonce, unique per message under a key.
+ * @param nonce_len The length of the nonce in bytes, at most 15.
+ * @param ad Associated data that is authenticated but not encrypted.
+ * @param ad_len The length of the associated data in bytes.
+ * @param plain_text The message.
+ * @param len The length of the message in bytes.
+ * @param output Where the len bytes of ciphertext are written.
+ * @param tag Where the 16-byte tag is written.
+ * @return 0 on success, -1 on bad arguments.
+ */
+int ocb_encrypt(struct ocb_context *ctx, unsigned char *nonce,
+                size_t nonce_len, unsigned char *ad, size_t ad_len,
+                unsigned char *plain_text, size_t len, unsigned char *output,
+                unsigned char *tag) {
+  return ocb_crypt(ctx, nonce, nonce_len, ad, ad_len, plain_text, len, output,
+                   tag, 0, 1);
+}
+
+/**
+ * Decrypts a message and verifies its tag.
+ *
+ * @param ctx The context initialised with ocb_init.
+ * @param nonce The nonce used for encryption.
+ * @param nonce_len The length of the nonce in bytes, at most 15.
+ * @param ad The associated data used for encryption.
+ * @param ad_len The length of the associated data in bytes.
+ * @param ciphertext The ciphertext.
+ * @param len The length of the ciphertext in bytes.
+ * @param tag The 16-byte tag that came with the ciphertext.
+ * @param output Where the len bytes of plain_text are written.
+ * @return 0 if the tag verifies, -1 otherwise.
+ */
+int ocb_decrypt(struct ocb_context *ctx, unsigned char *nonce,
+                size_t nonce_len, unsigned char *ad, size_t ad_len,
+                unsigned char *ciphertext, size_t len, unsigned char *tag,
+                unsigned char *output) {
+  return ocb_decrypt_mt(ctx, nonce, nonce_len, ad, ad_len, ciphertext, len,
+                        tag, output, 1);
+}
+
+/**
+ * Multi-threaded ocb_encrypt.
+ *
+ * @param nbr_threads The number of threads to split the full blocks across.
+ * @return 0 on success, -1 on bad arguments.
+ */
+int ocb_encrypt_mt(struct ocb_context *ctx, unsigned char *nonce,
+                   size_t nonce_len, unsigned char *ad, size_t ad_len,
+                   unsigned char *plain_text, size_t len,
+                   unsigned char *output, unsigned char *tag, int nbr_threads) {
+  return ocb_crypt(ctx, nonce, nonce_len, ad, ad_len, plain_text, len, output,
+                   tag, 0, nbr_threads);
+}
+
+/**
+ * Multi-threaded ocb_decrypt.
+ *
+ * @param nbr_threads The number of threads to split the full blocks across.
+ * @return 0 if the tag verifies, -1 otherwise.
+ */
+int ocb_decrypt_mt(struct ocb_context *ctx, unsigned char *nonce,
+                   size_t nonce_len, unsigned char *ad, size_t ad_len,
+                   unsigned char *ciphertext, size_t len, unsigned char *tag,
+                   unsigned char *output, int nbr_threads) {
+  unsigned char expected[OCB_TAG_SIZE];
+
+  if (ocb_crypt(ctx, nonce, nonce_len, ad, ad_len, ciphertext, len, output,
+                expected, 1, nbr_threads) != 0)
+    return -1;
+  if (!ocb_tag_matches(expected, tag)) {
+    if (len > 0) memset(output, 0, len);
+    return -1;
+  }
+  return 0;
+}
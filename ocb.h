@@ -0,0 +1,63 @@
+/*
+ * Salil Luley - D23124871
+ * This file, ocb.h, declares the OCB3 authenticated encryption mode (RFC 7253)
+ * built on top of the AES-128 block functions in rijndael.h. OCB needs a
+ * single block cipher call per block of data and every block can be processed
+ * independently, so both encryption and decryption parallelise. The ocb_context
+ * holds the expanded key together with the precomputed L table so that the
+ * per-message work is only the nonce setup. Tags are always 128 bits.
+ */
+
+#ifndef OCB_H
+#define OCB_H
+
+#include <stddef.h>
+
+#include "rijndael.h"
+
+#define OCB_TAG_SIZE 16
+#define OCB_MAX_NONCE_SIZE 15
+
+/*
+ * L[i] is needed for block numbers with i trailing zeros, so 32 entries cover
+ * messages of up to 2^32 blocks (64 GiB).
+ */
+#define OCB_L_TABLE_SIZE 32
+
+struct ocb_context {
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char l_star[BLOCK_SIZE];
+  unsigned char l_dollar[BLOCK_SIZE];
+  unsigned char l[OCB_L_TABLE_SIZE][BLOCK_SIZE];
+};
+
+void ocb_init(struct ocb_context *ctx, unsigned char *key);
+
+/*
+ * All functions return 0 on success and -1 on bad arguments. ocb_decrypt also
+ * returns -1 when the tag does not verify, in which case the output is wiped.
+ */
+int ocb_encrypt(struct ocb_context *ctx, unsigned char *nonce,
+                size_t nonce_len, unsigned char *ad, size_t ad_len,
+                unsigned char *plain_text, size_t len, unsigned char *output,
+                unsigned char *tag);
+int ocb_decrypt(struct ocb_context *ctx, unsigned char *nonce,
+                size_t nonce_len, unsigned char *ad, size_t ad_len,
+                unsigned char *ciphertext, size_t len, unsigned char *tag,
+                unsigned char *output);
+
+/*
+ * Multi-threaded variants for large buffers. The full blocks are split
+ * between nbr_threads threads; small inputs fall back to the single-threaded
+ * path.
+ */
+int ocb_encrypt_mt(struct ocb_context *ctx, unsigned char *nonce,
+                   size_t nonce_len, unsigned char *ad, size_t ad_len,
+                   unsigned char *plain_text, size_t len,
+                   unsigned char *output, unsigned char *tag, int nbr_threads);
+int ocb_decrypt_mt(struct ocb_context *ctx, unsigned char *nonce,
+                   size_t nonce_len, unsigned char *ad, size_t ad_len,
+                   unsigned char *ciphertext, size_t len, unsigned char *tag,
+                   unsigned char *output, int nbr_threads);
+
+#endif
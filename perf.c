@@ -0,0 +1,168 @@
+/**
+ *  Salil Luley - D23124871
+ * Hardware performance counters through perf_event_open, with a clean
+ * fallback when the host does not provide them.
+ */
+
+#include "perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rijndael.h"
+
+const char *const perf_event_names[PERF_NBR_EVENTS] = {
+    "cycles", "instructions", "L1D misses", "branch misses"};
+
+/**
+ * The perf type and config of each event, in the order of perf_event_names.
+ */
+static const struct {
+  unsigned int type;
+  unsigned long long config;
+} perf_events[PERF_NBR_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+/**
+ * Opens every event for the calling thread and the threads it starts later,
+ * disabled and counting user space only.
+ *
+ * @param counters The counters to open.
+ * @return The number of events opened.
+ */
+int perf_open(struct perf_counters *counters) {
+  struct perf_event_attr attr;
+  int i;
+
+  counters->nbr_open = 0;
+  counters->error = 0;
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[i].type;
+    attr.config = perf_events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    counters->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (counters->fd[i] >= 0)
+      counters->nbr_open++;
+    else if (counters->error == 0)
+      counters->error = errno;
+  }
+  return counters->nbr_open;
+}
+
+/**
+ * Closes every open event.
+ */
+void perf_close(struct perf_counters *counters) {
+  int i;
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    if (counters->fd[i] >= 0) close(counters->fd[i]);
+    counters->fd[i] = -1;
+  }
+  counters->nbr_open = 0;
+}
+
+/**
+ * Reads an event's value, time enabled and time running.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int read_event(int fd, unsigned long long *data) {
+  return read(fd, data, 3 * sizeof(unsigned long long)) ==
+                 (ssize_t)(3 * sizeof(unsigned long long))
+             ? 0
+             : -1;
+}
+
+/**
+ * Records where every open event stands and enables it. The counts are taken
+ * as differences from here rather than reset, because a reset does not clear
+ * what threads that have already exited added to an inherited event.
+ */
+void perf_start(struct perf_counters *counters) {
+  int i;
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    if (counters->fd[i] < 0) continue;
+    if (read_event(counters->fd[i], counters->start[i]) != 0)
+      memset(counters->start[i], 0, sizeof(counters->start[i]));
+    ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+/**
+ * Disables every open event and reads how much it counted since perf_start.
+ * When the kernel had to multiplex the counters, the value is scaled up by
+ * the fraction of time it was actually counting. An event that never ran is
+ * marked invalid.
+ *
+ * @param counters The counters.
+ * @param reading Where the values are stored.
+ */
+void perf_stop(struct perf_counters *counters, struct perf_reading *reading) {
+  unsigned long long data[3]; /* value, time enabled, time running */
+  int i;
+
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    if (counters->fd[i] >= 0)
+      ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    unsigned long long value, enabled, running;
+    reading->value[i] = 0;
+    reading->valid[i] = 0;
+    if (counters->fd[i] < 0 || read_event(counters->fd[i], data) != 0)
+      continue;
+    value = data[0] - counters->start[i][0];
+    enabled = data[1] - counters->start[i][1];
+    running = data[2] - counters->start[i][2];
+    if (running == 0) continue;
+    reading->value[i] = value;
+    if (running < enabled)
+      reading->value[i] =
+          (unsigned long long)((double)value * enabled / running);
+    reading->valid[i] = 1;
+  }
+}
+
+/**
+ * Prints one profiled run: the time per block, then each counter per block
+ * and per byte.
+ *
+ * @param name The name of the run.
+ * @param reading The counter values, or NULL for time only.
+ * @param seconds The wall time of the run.
+ * @param nbr_bytes The number of bytes processed.
+ */
+void perf_report(const char *name, struct perf_reading *reading,
+                 double seconds, unsigned long long nbr_bytes) {
+  double nbr_blocks = (double)nbr_bytes / BLOCK_SIZE;
+  int i;
+
+  printf("%-24s %10.1f ns/block %8.2f ns/byte\n", name,
+         seconds * 1e9 / nbr_blocks, seconds * 1e9 / nbr_bytes);
+  if (reading == NULL) return;
+  for (i = 0; i < PERF_NBR_EVENTS; i++) {
+    if (reading->valid[i])
+      printf("    %-20s %10.1f /block %10.3f /byte\n", perf_event_names[i],
+             reading->value[i] / nbr_blocks,
+             (double)reading->value[i] / nbr_bytes);
+    else
+      printf("    %-20s %10s\n", perf_event_names[i], "n/a");
+  }
+}
@@ -0,0 +1,48 @@
+/*
+ * Salil Luley - D23124871
+ * This file, perf.h, declares a small wrapper around the Linux
+ * perf_event_open system call for profiling the cipher kernels. It counts
+ * cycles, instructions, L1 data cache read misses and branch misses in user
+ * space only, so it works with the default perf_event_paranoid setting. The
+ * counts cover the calling thread and every thread it starts after
+ * perf_open, so open the counters before any worker threads exist. Each event
+ * is opened on its own. An event the host does not have, for example inside a
+ * virtual machine, is reported as unavailable and the rest are still counted.
+ * When no event can be opened the callers fall back to timing alone.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#define PERF_NBR_EVENTS 4
+
+struct perf_counters {
+  int fd[PERF_NBR_EVENTS]; /* -1 for an event that could not be opened */
+  int nbr_open;
+  int error; /* errno from the first event that failed to open */
+  unsigned long long start[PERF_NBR_EVENTS][3]; /* read by perf_start */
+};
+
+struct perf_reading {
+  unsigned long long value[PERF_NBR_EVENTS]; /* scaled if multiplexed */
+  int valid[PERF_NBR_EVENTS];
+};
+
+extern const char *const perf_event_names[PERF_NBR_EVENTS];
+
+/* Returns the number of events opened, 0 if none are available. */
+int perf_open(struct perf_counters *counters);
+void perf_close(struct perf_counters *counters);
+
+/* Enable the counters, then disable them and read what they counted. */
+void perf_start(struct perf_counters *counters);
+void perf_stop(struct perf_counters *counters, struct perf_reading *reading);
+
+/*
+ * Prints the time and every counter per 16-byte block and per byte for a run
+ * over nbr_bytes bytes.
+ */
+void perf_report(const char *name, struct perf_reading *reading,
+                 double seconds, unsigned long long nbr_bytes);
+
+#endif
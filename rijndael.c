@@ -6,6 +6,7 @@
 #include "rijndael.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "stdio.h"
 
@@ -577,4 +578,220 @@ unsigned char *aes_decrypt_block(unsigned char *ciphertext,
   free(expanded_key);
   expanded_key = NULL;
   return output;
-}
\ No newline at end of file
+}
+
+// Multi-block
+
+/**
+ * The number of blocks the multi-block engine carries through the rounds
+ * together. Each round key is rebuilt once per group instead of once per block.
+ */
+#define ENGINE_LANES 4
+
+/**
+ * Copies a 16-byte block while switching between the byte order used on the
+ * wire and the column-major order used by the state array. The operation is
+ * its own inverse, so it serves both for loading and storing.
+ *
+ * @param dst The destination block.
+ * @param src The source block.
+ */
+static void transpose_block(unsigned char *dst, unsigned char *src) {
+  int i, j;
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) dst[(i + (j * 4))] = src[(i * 4) + j];
+  }
+}
+
+/**
+ * Encrypts a run of consecutive blocks using an already expanded key.
+ *
+ * Blocks are processed in groups of ENGINE_LANES, with every block of a group
+ * going through a round before the next round key is created.
+ *
+ * @param input The plain_text blocks.
+ * @param output Where the cipher blocks are written. May be equal to input.
+ * @param nbr_blocks The number of 16-byte blocks to encrypt.
+ * @param expanded_key The key schedule produced by expand_key.
+ */
+void aes_encrypt_blocks(unsigned char *input, unsigned char *output,
+                        unsigned long nbr_blocks, unsigned char *expanded_key) {
+  unsigned char state[ENGINE_LANES][BLOCK_SIZE];
+  unsigned char roundKey[BLOCK_SIZE];
+  unsigned long done = 0;
+  int lanes, lane, round;
+
+  while (done < nbr_blocks) {
+    lanes = (nbr_blocks - done < ENGINE_LANES) ? (int)(nbr_blocks - done)
+                                               : ENGINE_LANES;
+    for (lane = 0; lane < lanes; lane++)
+      transpose_block(state[lane], input + (done + lane) * BLOCK_SIZE);
+
+    create_round_key(expanded_key, roundKey);
+    for (lane = 0; lane < lanes; lane++) add_round_key(state[lane], roundKey);
+    for (round = 1; round < NBR_ROUNDS; round++) {
+      create_round_key(expanded_key + BLOCK_SIZE * round, roundKey);
+      for (lane = 0; lane < lanes; lane++) {
+        sub_bytes(state[lane]);
+        shift_rows(state[lane]);
+        mix_columns(state[lane]);
+        add_round_key(state[lane], roundKey);
+      }
+    }
+    create_round_key(expanded_key + BLOCK_SIZE * NBR_ROUNDS, roundKey);
+    for (lane = 0; lane < lanes; lane++) {
+      sub_bytes(state[lane]);
+      shift_rows(state[lane]);
+      add_round_key(state[lane], roundKey);
+      transpose_block(output + (done + lane) * BLOCK_SIZE, state[lane]);
+    }
+    done += lanes;
+  }
+}
+
+/**
+ * Decrypts a run of consecutive blocks using an already expanded key.
+ *
+ * @param input The cipher blocks.
+ * @param output Where the plain_text blocks are written. May be equal to input.
+ * @param nbr_blocks The number of 16-byte blocks to decrypt.
+ * @param expanded_key The key schedule produced by expand_key.
+ */
+void aes_decrypt_blocks(unsigned char *input, unsigned char *output,
+                        unsigned long nbr_blocks, unsigned char *expanded_key) {
+  unsigned char state[ENGINE_LANES][BLOCK_SIZE];
+  unsigned char roundKey[BLOCK_SIZE];
+  unsigned long done = 0;
+  int lanes, lane, round;
+
+  while (done < nbr_blocks) {
+    lanes = (nbr_blocks - done < ENGINE_LANES) ? (int)(nbr_blocks - done)
+                                               : ENGINE_LANES;
+    for (lane = 0; lane < lanes; lane++)
+      transpose_block(state[lane], input + (done + lane) * BLOCK_SIZE);
+
+    create_round_key(expanded_key + BLOCK_SIZE * NBR_ROUNDS, roundKey);
+    for (lane = 0; lane < lanes; lane++) add_round_key(state[lane], roundKey);
+    for (round = NBR_ROUNDS - 1; round > 0; round--) {
+      create_round_key(expanded_key + BLOCK_SIZE * round, roundKey);
+      for (lane = 0; lane < lanes; lane++) {
+        invert_shift_rows(state[lane]);
+        invert_sub_bytes(state[lane]);
+        add_round_key(state[lane], roundKey);
+        invert_mix_columns(state[lane]);
+      }
+    }
+    create_round_key(expanded_key, roundKey);
+    for (lane = 0; lane < lanes; lane++) {
+      invert_shift_rows(state[lane]);
+      invert_sub_bytes(state[lane]);
+      add_round_key(state[lane], roundKey);
+      transpose_block(output + (done + lane) * BLOCK_SIZE, state[lane]);
+    }
+    done += lanes;
+  }
+}
+
+// On-the-fly key expansion
+
+/**
+ * Advances a 16-byte round key to the next round in place. This is one step
+ * of expand_key, working on the previous round key instead of the whole
+ * schedule.
+ *
+ * @param round_key The round key of round iteration - 1, replaced by the round
+ * key of round iteration.
+ * @param iteration The round being entered, from 1 to NBR_ROUNDS.
+ */
+static void next_round_key(unsigned char *round_key, int iteration) {
+  unsigned char t[4];
+  int i;
+
+  for (i = 0; i < 4; i++) t[i] = round_key[12 + i];
+  aes_key_schedule_core(t, iteration);
+  for (i = 0; i < 4; i++) round_key[i] ^= t[i];
+  for (i = 4; i < BLOCK_SIZE; i++) round_key[i] ^= round_key[i - 4];
+}
+
+/**
+ * Steps a 16-byte round key back to the previous round in place, undoing
+ * next_round_key.
+ *
+ * @param round_key The round key of round iteration, replaced by the round key
+ * of round iteration - 1.
+ * @param iteration The round being left, from 1 to NBR_ROUNDS.
+ */
+static void previous_round_key(unsigned char *round_key, int iteration) {
+  unsigned char t[4];
+  int i;
+
+  for (i = BLOCK_SIZE - 1; i >= 4; i--) round_key[i] ^= round_key[i - 4];
+  for (i = 0; i < 4; i++) t[i] = round_key[12 + i];
+  aes_key_schedule_core(t, iteration);
+  for (i = 0; i < 4; i++) round_key[i] ^= t[i];
+}
+
+/**
+ * Encrypts a single block, deriving each round key just before it is used.
+ *
+ * @param plain_text The plain_text block to be encrypted.
+ * @param key The encryption key.
+ * @param output Where the encrypted block is written.
+ */
+void aes_encrypt_block_otf(unsigned char *plain_text, unsigned char *key,
+                           unsigned char *output) {
+  unsigned char state[BLOCK_SIZE];
+  unsigned char key_words[BLOCK_SIZE];
+  unsigned char roundKey[BLOCK_SIZE];
+  int round;
+
+  transpose_block(state, plain_text);
+  memcpy(key_words, key, BLOCK_SIZE);
+  create_round_key(key_words, roundKey);
+  add_round_key(state, roundKey);
+
+  for (round = 1; round <= NBR_ROUNDS; round++) {
+    next_round_key(key_words, round);
+    create_round_key(key_words, roundKey);
+    sub_bytes(state);
+    shift_rows(state);
+    if (round < NBR_ROUNDS) mix_columns(state);
+    add_round_key(state, roundKey);
+  }
+  transpose_block(output, state);
+}
+
+/**
+ * Decrypts a single block without a key schedule buffer. The last round key
+ * is reached by running the schedule forward, then each earlier round key is
+ * recovered by running it backwards.
+ *
+ * @param ciphertext The ciphertext block to be decrypted.
+ * @param key The encryption key used for decryption.
+ * @param output Where the decrypted block is written.
+ */
+void aes_decrypt_block_otf(unsigned char *ciphertext, unsigned char *key,
+                           unsigned char *output) {
+  unsigned char state[BLOCK_SIZE];
+  unsigned char key_words[BLOCK_SIZE];
+  unsigned char roundKey[BLOCK_SIZE];
+  int round;
+
+  memcpy(key_words, key, BLOCK_SIZE);
+  for (round = 1; round <= NBR_ROUNDS; round++)
+    next_round_key(key_words, round);
+
+  transpose_block(state, ciphertext);
+  create_round_key(key_words, roundKey);
+  add_round_key(state, roundKey);
+
+  for (round = NBR_ROUNDS; round >= 1; round--) {
+    previous_round_key(key_words, round);
+    create_round_key(key_words, roundKey);
+    invert_shift_rows(state);
+    invert_sub_bytes(state);
+    add_round_key(state, roundKey);
+    if (round > 1) invert_mix_columns(state);
+  }
+  transpose_block(output, state);
+}
@@ -28,6 +28,8 @@
 
 #define BLOCK_ACCESS(block, row, col) (block[(row * 4) + col])
 #define BLOCK_SIZE 16
+#define NBR_ROUNDS 10
+#define EXPANDED_KEY_SIZE (BLOCK_SIZE * (NBR_ROUNDS + 1))
 
 /*
  * These should be the main encrypt/decrypt functions (i.e. the main
@@ -42,6 +44,26 @@ unsigned char get_rcon_value(unsigned char num);
 
 void aes_main(unsigned char *state, unsigned char *expanded_key,
               int nbr_rounds);
+
+/*
+ * Multi-block engine: encrypts/decrypts nbr_blocks consecutive 16-byte blocks
+ * with an already expanded key, writing into output (which may alias input).
+ * No memory is allocated, so these are the entry points for the modes.
+ */
+void aes_encrypt_blocks(unsigned char *input, unsigned char *output,
+                        unsigned long nbr_blocks, unsigned char *expanded_key);
+void aes_decrypt_blocks(unsigned char *input, unsigned char *output,
+                        unsigned long nbr_blocks, unsigned char *expanded_key);
+
+/*
+ * One-shot entry points for keys that are used for a single block. Each round
+ * key is derived just before the round that uses it, so there is no key
+ * schedule buffer and no allocation. The result goes into output.
+ */
+void aes_encrypt_block_otf(unsigned char *plain_text, unsigned char *key,
+                           unsigned char *output);
+void aes_decrypt_block_otf(unsigned char *ciphertext, unsigned char *key,
+                           unsigned char *output);
 void create_round_key(unsigned char *expanded_key, unsigned char *roundKey);
 void add_round_key(unsigned char *state, unsigned char *roundKey);
 void sub_bytes(unsigned char *state);
@@ -58,5 +80,7 @@ void invert_shift_rows(unsigned char *state);
 void invert_sub_bytes(unsigned char *state);
 void invert_mix_columns(unsigned char *state);
 void inv_mix_column(unsigned char *column);
+void aes_inv_main(unsigned char *state, unsigned char *expanded_key,
+                  int nbr_rounds);
 
 #endif
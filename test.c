@@ -1,7 +1,29 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "aesd.h"
+#include "async.h"
+#include "cmac.h"
+#include "aeshash.h"
+#include "container.h"
+#include "ctr.h"
+#include "gcm.h"
+#include "ocb.h"
 #include "rijndael.h"
 
 /**
@@ -34,6 +56,23 @@ int compare_arrays(unsigned char *arr1, unsigned char *arr2, int size) {
   return 1;  // Arrays are equal
 }
 
+/**
+ * Converts a hexadecimal string into bytes.
+ *
+ * @param hex The hexadecimal string, two characters per byte.
+ * @param out Where the bytes are written.
+ * @return The number of bytes written.
+ */
+int parse_hex(const char *hex, unsigned char *out) {
+  int n = 0;
+  unsigned int byte;
+  while (hex[2 * n] != '\0' && sscanf(hex + 2 * n, "%2x", &byte) == 1) {
+    out[n] = (unsigned char)byte;
+    n++;
+  }
+  return n;
+}
+
 /**
  * Function to test the AES encryption of a single block.
  *
@@ -91,6 +130,1338 @@ void test_aes_decrypt_block() {
   free(output);
 }
 
+/**
+ * Test function for the multi-block engine. Encrypts several blocks in place
+ * and compares each one with aes_encrypt_block, then decrypts them back.
+ * @return void
+ */
+void test_aes_encrypt_blocks() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char original[7 * BLOCK_SIZE];
+  unsigned char buffer[7 * BLOCK_SIZE];
+  int passed = 1;
+
+  for (int i = 0; i < (int)sizeof(original); i++) original[i] = (i * 7) & 0xff;
+  memcpy(buffer, original, sizeof(buffer));
+  expand_key(expanded_key, key);
+  aes_encrypt_blocks(buffer, buffer, 7, expanded_key);
+
+  for (int i = 0; i < 7; i++) {
+    unsigned char *output = aes_encrypt_block(original + i * BLOCK_SIZE, key);
+    if (memcmp(output, buffer + i * BLOCK_SIZE, BLOCK_SIZE) != 0) passed = 0;
+    free(output);
+  }
+
+  aes_decrypt_blocks(buffer, buffer, 7, expanded_key);
+  if (memcmp(buffer, original, sizeof(buffer)) != 0) passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for the on-the-fly key expansion path. Checks the known
+ * vector and then compares against aes_encrypt_block/aes_decrypt_block for a
+ * run of different keys.
+ * @return void
+ */
+void test_aes_block_otf() {
+  unsigned char plain_text[16] = {1, 2,  3,  4,  5,  6,  7,  8,
+                                  9, 10, 11, 12, 13, 14, 15, 16};
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char expected_output[16] = {0x4b, 0x95, 0x86, 0x93, 0xb4, 0xe9,
+                                       0xc4, 0xeb, 0x92, 0xb3, 0xe8, 0x69,
+                                       0xaf, 0x40, 0xe0, 0xce};
+  unsigned char output[16], recovered[16];
+  int passed = 1;
+
+  aes_encrypt_block_otf(plain_text, key, output);
+  aes_decrypt_block_otf(output, key, recovered);
+  if (memcmp(output, expected_output, 16) != 0 ||
+      memcmp(recovered, plain_text, 16) != 0)
+    passed = 0;
+
+  for (int k = 0; k < 32; k++) {
+    for (int i = 0; i < 16; i++) key[i] = (key[i] * 5 + k + i) & 0xff;
+    unsigned char *reference = aes_encrypt_block(plain_text, key);
+    aes_encrypt_block_otf(plain_text, key, output);
+    if (memcmp(output, reference, 16) != 0) passed = 0;
+    free(reference);
+
+    reference = aes_decrypt_block(plain_text, key);
+    aes_decrypt_block_otf(plain_text, key, output);
+    if (memcmp(output, reference, 16) != 0) passed = 0;
+    free(reference);
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for OCB3 against the AES-128 sample results of RFC 7253
+ * (appendix A). Each vector is encrypted, checked, and decrypted back.
+ * @return void
+ */
+void test_ocb_rfc7253() {
+  static const char *vectors[][3] = {
+      {"", "", "785407BFFFC8AD9EDCC5520AC9111EE6"},
+      {"0001020304050607", "0001020304050607",
+       "6820B3657B6F615A5725BDA0D3B4EB3A257C9AF1F8F03009"},
+      {"0001020304050607", "", "81017F8203F081277152FADE694A0A00"},
+      {"", "0001020304050607",
+       "45DD69F8F5AAE72414054CD1F35D82760B2CD00D2F99BFA9"},
+      {"000102030405060708090A0B0C0D0E0F", "000102030405060708090A0B0C0D0E0F",
+       "571D535B60B277188BE5147170A9A22C3AD7A4FF3835B8C5701C1CCEC8FC3358"},
+      {"",
+       "000102030405060708090A0B0C0D0E0F1011121314151617"
+       "18191A1B1C1D1E1F2021222324252627",
+       "4412923493C57D5DE0D700F753CCE0D1D2D95060122E9F15A5DDBFC5787E50B5"
+       "CC55EE507BCB084E479AD363AC366B95A98CA5F3000B1479"},
+  };
+  static const unsigned char nonce_ends[] = {0x00, 0x01, 0x02,
+                                             0x03, 0x04, 0x0f};
+  unsigned char key[16];
+  unsigned char nonce[12];
+  unsigned char ad[64], plain_text[64], expected[80];
+  unsigned char output[64], tag[OCB_TAG_SIZE], recovered[64];
+  struct ocb_context ctx;
+  int passed = 1;
+
+  parse_hex("000102030405060708090A0B0C0D0E0F", key);
+  ocb_init(&ctx, key);
+
+  for (int v = 0; v < 6; v++) {
+    parse_hex("BBAA99887766554433221100", nonce);
+    nonce[11] = nonce_ends[v];
+    int ad_len = parse_hex(vectors[v][0], ad);
+    int len = parse_hex(vectors[v][1], plain_text);
+    parse_hex(vectors[v][2], expected);
+
+    ocb_encrypt(&ctx, nonce, 12, ad, ad_len, plain_text, len, output, tag);
+    if (memcmp(output, expected, len) != 0 ||
+        memcmp(tag, expected + len, OCB_TAG_SIZE) != 0)
+      passed = 0;
+    if (ocb_decrypt(&ctx, nonce, 12, ad, ad_len, output, len, tag,
+                    recovered) != 0 ||
+        memcmp(recovered, plain_text, len) != 0)
+      passed = 0;
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for the multi-threaded OCB3 path. A buffer large enough to be
+ * split across threads must give the same ciphertext and tag as the
+ * single-threaded path, and a flipped ciphertext bit must be rejected.
+ * @return void
+ */
+void test_ocb_multi_thread() {
+  size_t len = 64 * 1024 + 5;
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char nonce[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  unsigned char tag[OCB_TAG_SIZE], tag_mt[OCB_TAG_SIZE];
+  unsigned char *plain_text = malloc(len);
+  unsigned char *output = malloc(len);
+  unsigned char *output_mt = malloc(len);
+  struct ocb_context ctx;
+  int passed = 1;
+
+  for (size_t i = 0; i < len; i++) plain_text[i] = (i * 31) & 0xff;
+  ocb_init(&ctx, key);
+
+  ocb_encrypt(&ctx, nonce, 12, NULL, 0, plain_text, len, output, tag);
+  ocb_encrypt_mt(&ctx, nonce, 12, NULL, 0, plain_text, len, output_mt, tag_mt,
+                 4);
+  if (memcmp(output, output_mt, len) != 0 ||
+      memcmp(tag, tag_mt, OCB_TAG_SIZE) != 0)
+    passed = 0;
+
+  if (ocb_decrypt_mt(&ctx, nonce, 12, NULL, 0, output_mt, len, tag_mt,
+                     output_mt, 3) != 0 ||
+      memcmp(output_mt, plain_text, len) != 0)
+    passed = 0;
+
+  output[len / 2] ^= 0x01;
+  if (ocb_decrypt_mt(&ctx, nonce, 12, NULL, 0, output, len, tag, output, 4) ==
+      0)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  free(plain_text);
+  free(output);
+  free(output_mt);
+}
+
+/**
+ * A small deterministic generator for the hash tests (xorshift64).
+ *
+ * @param state The generator state, updated in place.
+ * @return The next 64-bit value.
+ */
+unsigned long long test_random(unsigned long long *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/**
+ * Avalanche test for aes_hash128, in the style of SMHasher. For random inputs
+ * of a few lengths, every input bit is flipped and every output bit must
+ * change with a probability close to one half.
+ * @return void
+ */
+void test_aes_hash_avalanche() {
+  static const int lengths[] = {3, 16, 33};
+  const int trials = 300;
+  unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char input[33], base[16], flipped[16];
+  static int counts[33 * 8][128];
+  struct aes_hash_key hkey;
+  double worst = 0;
+
+  aes_hash_init(&hkey, key);
+  for (int l = 0; l < 3; l++) {
+    int len = lengths[l];
+    memset(counts, 0, sizeof(counts));
+    for (int t = 0; t < trials; t++) {
+      for (int i = 0; i < len; i++) input[i] = test_random(&seed) & 0xff;
+      aes_hash128(&hkey, input, len, base);
+      for (int bit = 0; bit < len * 8; bit++) {
+        input[bit / 8] ^= 1 << (bit % 8);
+        aes_hash128(&hkey, input, len, flipped);
+        input[bit / 8] ^= 1 << (bit % 8);
+        for (int out = 0; out < 128; out++)
+          counts[bit][out] +=
+              ((base[out / 8] ^ flipped[out / 8]) >> (out % 8)) & 1;
+      }
+    }
+    for (int bit = 0; bit < len * 8; bit++) {
+      for (int out = 0; out < 128; out++) {
+        double bias = (double)counts[bit][out] / trials - 0.5;
+        if (bias < 0) bias = -bias;
+        if (bias > worst) worst = bias;
+      }
+    }
+  }
+
+  printf(worst < 0.15 ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Known-answer test for aes_hash128, run once with the portable rounds and
+ * once with AES-NI when the processor has it, so both paths are pinned to the
+ * same values. The inputs are 0, 15, 16 and 40 bytes of 0, 1, 2, ...
+ * @return void
+ */
+void test_aes_hash_vectors() {
+  static const char *expected_hex[4] = {"90F8034005B1CC1E5A757F6EBE780EB3",
+                                        "BC34A92AF67517B43D7F6A9123DF578C",
+                                        "DECDEEBB42FCF6E5CD3C4664A1159FED",
+                                        "9D98DD7FB6079C0481F852835ED8AD76"};
+  static const size_t lens[4] = {0, 15, 16, 40};
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char data[40], expected[16], out[16];
+  struct aes_hash_key hkey;
+  int passed = 1;
+
+  for (int i = 0; i < 40; i++) data[i] = (unsigned char)i;
+  aes_hash_init(&hkey, key);
+  for (int aesni = 0; aesni < 2; aesni++) {
+    aes_hash_select(aesni);
+    for (int i = 0; i < 4; i++) {
+      parse_hex(expected_hex[i], expected);
+      aes_hash128(&hkey, data, lens[i], out);
+      if (memcmp(out, expected, 16) != 0) passed = 0;
+    }
+  }
+  aes_hash_select(1);
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Comparison function for sorting 64-bit hashes.
+ */
+int compare_hashes(const void *a, const void *b) {
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Collision and sparse-key tests for aes_hash64, in the style of SMHasher.
+ * Sequential non-zero 8-byte counters, all-zero inputs of every length up to
+ * 256, and the same input under keys differing in one bit must all hash
+ * differently.
+ * @return void
+ */
+void test_aes_hash_collisions() {
+  const int nbr_counters = 1 << 16;
+  const int nbr_zeros = 257;
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char zeros[256] = {0};
+  unsigned long long *hashes =
+      malloc((nbr_counters + nbr_zeros + 128) * sizeof(unsigned long long));
+  struct aes_hash_key hkey;
+  int n = 0, passed = 1;
+
+  aes_hash_init(&hkey, key);
+  for (int i = 0; i < nbr_counters; i++) {
+    unsigned char counter[8] = {0};
+    for (int b = 0; b < 4; b++) counter[b] = ((i + 1) >> (8 * b)) & 0xff;
+    hashes[n++] = aes_hash64(&hkey, counter, sizeof(counter));
+  }
+  for (int len = 0; len < nbr_zeros; len++)
+    hashes[n++] = aes_hash64(&hkey, zeros, len);
+  for (int bit = 0; bit < 128; bit++) {
+    struct aes_hash_key other;
+    key[bit / 8] ^= 1 << (bit % 8);
+    aes_hash_init(&other, key);
+    key[bit / 8] ^= 1 << (bit % 8);
+    hashes[n++] = aes_hash64(&other, zeros, 16);
+  }
+
+  qsort(hashes, n, sizeof(unsigned long long), compare_hashes);
+  for (int i = 1; i < n; i++) {
+    if (hashes[i] == hashes[i - 1]) passed = 0;
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  free(hashes);
+}
+
+/**
+ * Multiplies by x in GF(2^8) with the AES polynomial.
+ */
+static unsigned char gf_double(unsigned char a) {
+  return (unsigned char)((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+}
+
+/**
+ * Differential collision test for aes_hash64 on two-block inputs. A one-byte
+ * difference delta in the first block, followed by a second-block difference
+ * equal to MixColumns of a one-byte difference gamma, is the pattern that
+ * cancels in both lanes when a block is absorbed by a single round. Every
+ * delta and gamma for the first byte is tried against the all-zero input.
+ * @return void
+ */
+void test_aes_hash_differential() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char input[32] = {0};
+  struct aes_hash_key hkey;
+  unsigned long long base;
+  int passed = 1;
+
+  aes_hash_init(&hkey, key);
+  base = aes_hash64(&hkey, input, 32);
+  for (int delta = 1; delta < 256; delta++) {
+    for (int gamma = 1; gamma < 256; gamma++) {
+      unsigned char g = (unsigned char)gamma;
+      input[0] = (unsigned char)delta;
+      input[16] = gf_double(g);
+      input[17] = g;
+      input[18] = g;
+      input[19] = gf_double(g) ^ g;
+      if (aes_hash64(&hkey, input, 32) == base) passed = 0;
+    }
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for CTR mode against the AES-128 example of NIST SP 800-38A
+ * (F.5.1), whose counter carries across a byte boundary.
+ * @return void
+ */
+void test_ctr_sp800_38a() {
+  unsigned char key[16], counter[16], plain_text[32], expected[32];
+  unsigned char output[32];
+  struct ctr_context ctx;
+
+  parse_hex("2B7E151628AED2A6ABF7158809CF4F3C", key);
+  parse_hex("F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF", counter);
+  parse_hex("6BC1BEE22E409F96E93D7E117393172A"
+            "AE2D8A571E03AC9C9EB76FAC45AF8E51",
+            plain_text);
+  parse_hex("874D6191B620E3261BEF6864990DB6CE"
+            "9806F66B7970FDFF8617187BB9FFFDFF",
+            expected);
+
+  ctr_init(&ctx, key);
+  ctr_crypt(&ctx, counter, plain_text, output, 32);
+  printf(memcmp(output, expected, 32) == 0 ? "Test passed!\n"
+                                           : "Test failed!\n");
+}
+
+/**
+ * Test function for CMAC against the four AES-128 examples of RFC 4493:
+ * an empty message, one full block, a partial last block and four blocks.
+ * @return void
+ */
+void test_cmac_rfc4493() {
+  static const size_t lens[4] = {0, 16, 40, 64};
+  static const char *expected_hex[4] = {"BB1D6929E95937287FA37D129B756746",
+                                        "070A16B46B4D4144F79BDD9DD04A287C",
+                                        "DFA66747DE9AE63030CA32611497C827",
+                                        "51F0BEBF7E3B9D92FC49741779363CFE"};
+  unsigned char key[16], message[64], expected[16], tag[16];
+  struct cmac_context ctx;
+  int passed = 1;
+
+  parse_hex("2B7E151628AED2A6ABF7158809CF4F3C", key);
+  parse_hex("6BC1BEE22E409F96E93D7E117393172A"
+            "AE2D8A571E03AC9C9EB76FAC45AF8E51"
+            "30C81C46A35CE411E5FBC1191A0A52EF"
+            "F69F2445DF4F9B17AD2B417BE66C3710",
+            message);
+  cmac_init(&ctx, key);
+  for (int i = 0; i < 4; i++) {
+    parse_hex(expected_hex[i], expected);
+    cmac(&ctx, message, lens[i], tag);
+    if (memcmp(tag, expected, 16) != 0) passed = 0;
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for GCM against test cases 2, 3 and 4 of the GCM
+ * specification (McGrew and Viega), including a decryption that must fail
+ * after a tag bit is flipped.
+ * @return void
+ */
+void test_gcm_vectors() {
+  unsigned char key[16], iv[12], ad[20], plain_text[64], expected[64];
+  unsigned char expected_tag[16], output[64], tag[16], recovered[64];
+  struct gcm_context ctx;
+  int passed = 1;
+
+  memset(key, 0, 16);
+  memset(iv, 0, 12);
+  memset(plain_text, 0, 16);
+  gcm_init(&ctx, key);
+  parse_hex("0388DACE60B6A392F328C2B971B2FE78", expected);
+  parse_hex("AB6E47D42CEC13BDF53A67B21257BDDF", expected_tag);
+  gcm_encrypt(&ctx, iv, 12, NULL, 0, plain_text, 16, output, tag);
+  if (memcmp(output, expected, 16) != 0 || memcmp(tag, expected_tag, 16) != 0)
+    passed = 0;
+
+  parse_hex("FEFFE9928665731C6D6A8F9467308308", key);
+  parse_hex("CAFEBABEFACEDBADDECAF888", iv);
+  parse_hex("D9313225F88406E5A55909C5AFF5269A86A7A9531534F7DA2E4C303D8A318A72"
+            "1C3C0C95956809532FCF0E2449A6B525B16AEDF5AA0DE657BA637B391AAFD255",
+            plain_text);
+  parse_hex("42831EC2217774244B7221B784D0D49CE3AA212F2C02A4E035C17E2329ACA12E"
+            "21D514B25466931C7D8F6A5AAC84AA051BA30B396A0AAC973D58E091473F5985",
+            expected);
+  gcm_init(&ctx, key);
+  parse_hex("4D5C2AF327CD64A62CF35ABD2BA6FAB4", expected_tag);
+  gcm_encrypt(&ctx, iv, 12, NULL, 0, plain_text, 64, output, tag);
+  if (memcmp(output, expected, 64) != 0 || memcmp(tag, expected_tag, 16) != 0)
+    passed = 0;
+
+  parse_hex("FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2", ad);
+  parse_hex("5BC94FBC3221A5DB94FAE95AE7121A47", expected_tag);
+  gcm_encrypt(&ctx, iv, 12, ad, 20, plain_text, 60, output, tag);
+  if (memcmp(output, expected, 60) != 0 || memcmp(tag, expected_tag, 16) != 0)
+    passed = 0;
+  if (gcm_decrypt(&ctx, iv, 12, ad, 20, output, 60, tag, recovered) != 0 ||
+      memcmp(recovered, plain_text, 60) != 0)
+    passed = 0;
+  tag[0] ^= 0x80;
+  if (gcm_decrypt(&ctx, iv, 12, ad, 20, output, 60, tag, recovered) == 0)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Splits a buffer into iovecs at the given cut points.
+ *
+ * @return The number of iovecs written.
+ */
+int split_iov(unsigned char *data, size_t len, const size_t *cuts,
+              int nbr_cuts, struct iovec *iov) {
+  size_t start = 0;
+  int n = 0;
+  for (int i = 0; i < nbr_cuts && cuts[i] <= len; i++) {
+    iov[n].iov_base = data + start;
+    iov[n].iov_len = cuts[i] - start;
+    start = cuts[i];
+    n++;
+  }
+  iov[n].iov_base = data + start;
+  iov[n].iov_len = len - start;
+  return n + 1;
+}
+
+/**
+ * Test function for the scatter-gather CTR and GCM paths. The input and
+ * output are cut into fragments at different places, including empty
+ * fragments and blocks straddling several fragments. The results must match
+ * the contiguous calls.
+ * @return void
+ */
+void test_stream_iov() {
+  static const size_t in_cuts[] = {0, 5, 21, 21, 100, 117, 118, 300};
+  static const size_t out_cuts[] = {16, 17, 40, 64, 250, 251, 252, 253};
+  const size_t len = 333;
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char iv[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  unsigned char counter[16] = {0}, counter_iov[16] = {0};
+  unsigned char plain_text[333], expected[333], fragmented[333];
+  unsigned char tag[16], tag_iov[16];
+  struct iovec in[9], out[9];
+  struct ctr_context ctr;
+  struct gcm_context gcm;
+  int nbr_in, nbr_out, passed = 1;
+
+  for (size_t i = 0; i < len; i++) plain_text[i] = (i * 11) & 0xff;
+  nbr_in = split_iov(plain_text, len, in_cuts, 8, in);
+  nbr_out = split_iov(fragmented, len, out_cuts, 8, out);
+
+  ctr_init(&ctr, key);
+  ctr_crypt(&ctr, counter, plain_text, expected, len);
+  ctr_crypt_iov(&ctr, counter_iov, in, nbr_in, out, nbr_out);
+  if (memcmp(expected, fragmented, len) != 0 ||
+      memcmp(counter, counter_iov, 16) != 0)
+    passed = 0;
+
+  gcm_init(&gcm, key);
+  gcm_encrypt(&gcm, iv, 12, key, 16, plain_text, len, expected, tag);
+  gcm_encrypt_iov(&gcm, iv, 12, key, 16, in, nbr_in, out, nbr_out, tag_iov);
+  if (memcmp(expected, fragmented, len) != 0 || memcmp(tag, tag_iov, 16) != 0)
+    passed = 0;
+
+  // Decrypt in place through the output fragmentation.
+  if (gcm_decrypt_iov(&gcm, iv, 12, key, 16, out, nbr_out, tag, out,
+                      nbr_out) != 0 ||
+      memcmp(fragmented, plain_text, len) != 0)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for the seekable container. Writes a container in uneven
+ * pieces, reads it back whole and in ranges that cross chunk boundaries, then
+ * checks that a corrupted chunk only fails reads that touch it and that a
+ * truncated file does not open.
+ * @return void
+ */
+void test_container() {
+  const size_t len = 5 * 1024 + 123;
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char *plain_text = malloc(len);
+  unsigned char *output = malloc(len);
+  struct container_writer *writer;
+  struct container_reader *reader;
+  FILE *file = tmpfile();
+  int fd = fileno(file);
+  int passed = 1;
+  unsigned char byte;
+  long size;
+
+  for (size_t i = 0; i < len; i++) plain_text[i] = (i * 13) & 0xff;
+
+  writer = container_writer_open(fd, key, 1024, 3);
+  for (size_t done = 0; done < len; done += 700) {
+    size_t n = len - done < 700 ? len - done : 700;
+    if (container_writer_write(writer, plain_text + done, n) != 0) passed = 0;
+  }
+  if (container_writer_close(writer) != 0) passed = 0;
+
+  reader = container_reader_open(fd, key, 2);
+  if (reader == NULL || container_reader_size(reader) != len) {
+    printf("Test failed!\n");
+    return;
+  }
+  if (container_read(reader, 0, output, len) != 0 ||
+      memcmp(output, plain_text, len) != 0)
+    passed = 0;
+  if (container_read(reader, 1000, output, 3000) != 0 ||
+      memcmp(output, plain_text + 1000, 3000) != 0)
+    passed = 0;
+  if (container_read(reader, len - 5, output, 5) != 0 ||
+      memcmp(output, plain_text + len - 5, 5) != 0)
+    passed = 0;
+  if (container_read(reader, len - 5, output, 6) == 0) passed = 0;
+  container_reader_close(reader);
+
+  // Flip a byte inside the third chunk.
+  pread(fd, &byte, 1, CONTAINER_HEADER_SIZE + 2 * (1024 + 16) + 10);
+  byte ^= 0x01;
+  pwrite(fd, &byte, 1, CONTAINER_HEADER_SIZE + 2 * (1024 + 16) + 10);
+  reader = container_reader_open(fd, key, 2);
+  if (reader == NULL || container_read(reader, 0, output, 2048) != 0 ||
+      container_read(reader, 2040, output, 20) == 0)
+    passed = 0;
+  container_reader_close(reader);
+
+  size = lseek(fd, 0, SEEK_END);
+  if (ftruncate(fd, size - 1) != 0 ||
+      container_reader_open(fd, key, 1) != NULL)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  fclose(file);
+  free(plain_text);
+  free(output);
+}
+
+/**
+ * Starts ./aesd on the given socket path with its standard error sent to
+ * log_fd, or discarded if log_fd is -1, so ./test prints only results.
+ *
+ * @return The daemon's process id.
+ */
+pid_t start_aesd(const char *path, int log_fd) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = log_fd >= 0 ? log_fd : open("/dev/null", O_WRONLY);
+    if (fd >= 0) dup2(fd, STDERR_FILENO);
+    execl("./aesd", "aesd", path, (char *)NULL);
+    _exit(127);
+  }
+  return pid;
+}
+
+/**
+ * Connects to the daemon and sends the hello with the given memory, without
+ * the checks and sealing that aesd_connect does.
+ *
+ * @param path The daemon's socket path.
+ * @param shm_fd The memfd to hand over.
+ * @param shm_size The size announced in the hello.
+ * @return The socket, or -1 on error.
+ */
+int raw_aesd_connect(const char *path, int shm_fd, size_t shm_size) {
+  struct sockaddr_un addr;
+  struct aesd_hello hello = {AESD_MAGIC, AESD_VERSION, shm_size};
+  struct msghdr msg;
+  struct iovec iov = {&hello, sizeof(hello)};
+  struct cmsghdr *cmsg;
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Connects to the daemon with a memfd that is not sealed, then shrinks it to
+ * nothing and asks for an encryption in the part that is gone. A daemon that
+ * mapped the region would die of SIGBUS.
+ *
+ * @param path The daemon's socket path.
+ * @return 0 if the daemon dropped the connection, -1 if it answered.
+ */
+int send_shrunk_region(const char *path) {
+  struct aesd_request request;
+  struct aesd_response response;
+  int shm_fd = memfd_create("rogue", 0);
+  int fd = -1;
+  int result = 0;
+
+  if (shm_fd < 0 || ftruncate(shm_fd, 4096) != 0 ||
+      (fd = raw_aesd_connect(path, shm_fd, 4096)) < 0) {
+    result = -1;
+    goto done;
+  }
+
+  // Register a key and encrypt the first block of the shrunk region.
+  memset(&request, 0, sizeof(request));
+  request.op = AESD_OP_REGISTER_KEY;
+  send(fd, &request, sizeof(request), MSG_NOSIGNAL);
+  if (ftruncate(shm_fd, 0) != 0) result = -1;
+  request.op = AESD_OP_ENCRYPT_BLOCKS;
+  request.id = 1;
+  request.len = BLOCK_SIZE;
+  send(fd, &request, sizeof(request), MSG_NOSIGNAL);
+  if (recv(fd, &response, sizeof(response), MSG_WAITALL) > 0) result = -1;
+
+done:
+  if (fd >= 0) close(fd);
+  if (shm_fd >= 0) close(shm_fd);
+  return result;
+}
+
+/**
+ * Test function for the encryption daemon. Starts ./aesd on a private socket,
+ * has two clients with the same key encrypt through it, and compares the
+ * results with the in-process engine. Bad key ids and out-of-range buffers
+ * must be refused, and so must a client whose shared memory can shrink, with
+ * the daemon staying up for everyone else.
+ * @return void
+ */
+void test_aesd() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char expected[64];
+  struct aesd_conn *first = NULL, *second = NULL;
+  char path[64];
+  int passed = 1;
+  pid_t pid;
+
+  snprintf(path, sizeof(path), "/tmp/aesd-test-%d.sock", (int)getpid());
+  pid = start_aesd(path, -1);
+  for (int i = 0; i < 100 && first == NULL; i++) {
+    first = aesd_connect(path, 64);
+    if (first == NULL) usleep(20000);
+  }
+  second = aesd_connect(path, 64);
+  if (first == NULL || second == NULL) {
+    printf("Test failed!\n");
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  for (int i = 0; i < 64; i++) expected[i] = (i * 3) & 0xff;
+  memcpy(aesd_buffer(first), expected, 64);
+  memcpy(aesd_buffer(second), expected, 64);
+  expand_key(expanded_key, key);
+  aes_encrypt_blocks(expected, expected, 4, expanded_key);
+
+  int first_key = aesd_register_key(first, key);
+  int second_key = aesd_register_key(second, key);
+  if (first_key < 0 || second_key < 0 ||
+      aesd_encrypt_blocks(first, first_key, 0, 64) != AESD_OK ||
+      aesd_encrypt_blocks(second, second_key, 16, 32) != AESD_OK ||
+      memcmp(aesd_buffer(first), expected, 64) != 0 ||
+      memcmp(aesd_buffer(second) + 16, expected + 16, 32) != 0)
+    passed = 0;
+  if (aesd_decrypt_blocks(first, first_key, 0, 64) != AESD_OK ||
+      memcmp(aesd_buffer(first), aesd_buffer(second), 16) != 0)
+    passed = 0;
+  if (aesd_encrypt_blocks(first, first_key + 7, 0, 16) != AESD_ERR_NO_KEY ||
+      aesd_encrypt_blocks(first, first_key, 48, 32) != AESD_ERR_INVALID ||
+      aesd_encrypt_blocks(first, first_key, 0, 8) != AESD_ERR_INVALID)
+    passed = 0;
+  if (send_shrunk_region(path) != 0 || waitpid(pid, NULL, WNOHANG) != 0 ||
+      aesd_encrypt_blocks(first, first_key, 0, 16) != AESD_OK)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  aesd_close(first);
+  aesd_close(second);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+/**
+ * Callback for test_async: counts the jobs that finished through it.
+ */
+static void count_job(struct aes_job *job) { (*(int *)job->user_data)++; }
+
+/**
+ * Test function for the asynchronous job queue. Fills a queue with ECB, CTR,
+ * GCM and OCB jobs until it refuses more, reaps them through the eventfd and
+ * aes_async_wait, and compares the results with the direct calls. A forged
+ * tag must come back as an authentication failure and a bad IV length as an
+ * invalid job, a callback job must not reach the completion queue, and the
+ * timestamps must be in order.
+ * @return void
+ */
+void test_async() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char iv[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  static const int modes[4] = {AES_JOB_GCM_ENCRYPT, AES_JOB_GCM_DECRYPT,
+                               AES_JOB_GCM_DECRYPT, AES_JOB_OCB_DECRYPT};
+  static const size_t iv_lens[4] = {17, 0, 1000, 16};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char plain_text[256], expected[256], tag[16], counter[16] = {0};
+  unsigned char output[6][256];
+  struct ctr_context ctr;
+  struct gcm_context gcm;
+  struct ocb_context ocb;
+  struct aes_job jobs[6], extra, *done[6];
+  struct aes_async_stats stats;
+  struct aes_async *queue = aes_async_create(2, 5, 2);
+  struct pollfd pfd;
+  int reaped = 0, callbacks = 0, passed = 1;
+
+  if (queue == NULL) {
+    printf("Test failed!\n");
+    return;
+  }
+  for (int i = 0; i < 256; i++) plain_text[i] = (i * 7) & 0xff;
+  expand_key(expanded_key, key);
+  ctr_init(&ctr, key);
+  gcm_init(&gcm, key);
+  ocb_init(&ocb, key);
+
+  memset(jobs, 0, sizeof(jobs));
+  for (int i = 0; i < 6; i++) {
+    jobs[i].input = plain_text;
+    jobs[i].output = output[i];
+    jobs[i].len = 256;
+    memcpy(jobs[i].iv, iv, 12);
+    jobs[i].iv_len = 12;
+  }
+  jobs[0].mode = AES_JOB_ECB_ENCRYPT;
+  jobs[0].ctx = expanded_key;
+  jobs[1].mode = AES_JOB_CTR;
+  jobs[1].ctx = &ctr;
+  memset(jobs[1].iv, 0, 16);
+  jobs[2].mode = AES_JOB_GCM_ENCRYPT;
+  jobs[2].ctx = &gcm;
+  jobs[3].mode = AES_JOB_OCB_ENCRYPT;
+  jobs[3].ctx = &ocb;
+  jobs[4].mode = AES_JOB_GCM_DECRYPT;  // random tag: must fail
+  jobs[4].ctx = &gcm;
+  jobs[5].mode = AES_JOB_ECB_DECRYPT;
+  jobs[5].ctx = expanded_key;
+  jobs[5].callback = count_job;
+  jobs[5].user_data = &callbacks;
+
+  // Five jobs fill the queue until they are reaped.
+  for (int i = 0; i < 5; i++) {
+    if (aes_async_submit(queue, &jobs[i]) != 0) passed = 0;
+  }
+  if (aes_async_submit(queue, &jobs[5]) == 0) passed = 0;
+
+  pfd.fd = aes_async_eventfd(queue);
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 5000) != 1) passed = 0;
+  reaped += aes_async_poll(queue, done, 1);
+  while (reaped < 5) {
+    int n = aes_async_wait(queue, done + reaped, 5 - reaped, 5000);
+    if (n == 0) break;
+    reaped += n;
+  }
+  if (reaped != 5 || aes_async_wait(queue, done, 1, 0) != 0) passed = 0;
+  for (int i = 0; i < reaped; i++) {
+    if (done[i]->submit_ns > done[i]->start_ns ||
+        done[i]->start_ns > done[i]->complete_ns)
+      passed = 0;
+  }
+
+  aes_encrypt_blocks(plain_text, expected, 16, expanded_key);
+  if (jobs[0].status != AES_JOB_OK || memcmp(output[0], expected, 256) != 0)
+    passed = 0;
+  ctr_crypt(&ctr, counter, plain_text, expected, 256);
+  if (jobs[1].status != AES_JOB_OK || memcmp(output[1], expected, 256) != 0 ||
+      memcmp(jobs[1].iv, counter, 16) != 0)
+    passed = 0;
+  gcm_encrypt(&gcm, iv, 12, NULL, 0, plain_text, 256, expected, tag);
+  if (jobs[2].status != AES_JOB_OK || memcmp(output[2], expected, 256) != 0 ||
+      memcmp(jobs[2].tag, tag, 16) != 0)
+    passed = 0;
+  ocb_encrypt(&ocb, iv, 12, NULL, 0, plain_text, 256, expected, tag);
+  if (jobs[3].status != AES_JOB_OK || memcmp(output[3], expected, 256) != 0 ||
+      memcmp(jobs[3].tag, tag, 16) != 0)
+    passed = 0;
+  if (jobs[4].status != AES_JOB_ERR_AUTH) passed = 0;
+
+  // Room again: the callback job and a bad ECB length.
+  memset(&extra, 0, sizeof(extra));
+  extra.mode = AES_JOB_ECB_ENCRYPT;
+  extra.ctx = expanded_key;
+  extra.input = plain_text;
+  extra.output = output[4];
+  extra.len = 15;
+  if (aes_async_submit_wait(queue, &jobs[5]) != 0 ||
+      aes_async_submit(queue, &extra) != 0 ||
+      aes_async_wait(queue, done, 1, 5000) != 1 || done[0] != &extra ||
+      extra.status != AES_JOB_ERR_INVALID)
+    passed = 0;
+
+  // IV lengths that do not fit the job are refused, not read past iv or
+  // reported as a failed tag.
+  for (int i = 0; i < 4; i++) {
+    extra.mode = modes[i];
+    extra.ctx = modes[i] == AES_JOB_OCB_DECRYPT ? (void *)&ocb : (void *)&gcm;
+    extra.len = 256;
+    extra.iv_len = iv_lens[i];
+    if (aes_async_submit(queue, &extra) != 0 ||
+        aes_async_wait(queue, done, 1, 5000) != 1 ||
+        extra.status != AES_JOB_ERR_INVALID)
+      passed = 0;
+  }
+
+  aes_async_get_stats(queue, &stats);
+  if (stats.completed < 6 || stats.batches == 0 || stats.max_latency_ns == 0)
+    passed = 0;
+
+  // Destroying the queue finishes the callback job.
+  aes_async_destroy(queue);
+  aes_encrypt_blocks(output[5], expected, 16, expanded_key);
+  if (callbacks != 1 || jobs[5].status != AES_JOB_OK ||
+      memcmp(expected, plain_text, 256) != 0)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * @brief State shared with the callback of test_async_callback_ownership.
+ */
+struct resubmit_state {
+  struct aes_async *queue;
+  int runs;
+  int failed;
+};
+
+/**
+ * Callback for test_async_callback_ownership: resubmits its job twice into
+ * the full queue, then frees it.
+ */
+static void resubmit_or_free(struct aes_job *job) {
+  struct resubmit_state *state = (struct resubmit_state *)job->user_data;
+  int runs = __atomic_load_n(&state->runs, __ATOMIC_SEQ_CST) + 1;
+
+  if (job->status != AES_JOB_OK) state->failed = 1;
+  if (runs < 3) {
+    if (aes_async_submit(state->queue, job) != 0) state->failed = 1;
+  } else {
+    free(job->output);
+    free(job);
+  }
+  __atomic_store_n(&state->runs, runs, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Test function for callback jobs that outlive their queue slot. A single
+ * worker serves a queue with room for one job, and the job's callback
+ * resubmits it and finally frees it. Resubmitting must find the slot free,
+ * and the worker must not touch the job after calling the callback.
+ * @return void
+ */
+void test_async_callback_ownership() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char plain_text[64] = {0};
+  struct resubmit_state state = {NULL, 0, 0};
+  struct aes_job *job = calloc(1, sizeof(struct aes_job));
+  int passed = 1;
+
+  state.queue = aes_async_create(1, 1, 1);
+  if (state.queue == NULL || job == NULL) {
+    printf("Test failed!\n");
+    return;
+  }
+  expand_key(expanded_key, key);
+  job->mode = AES_JOB_ECB_ENCRYPT;
+  job->ctx = expanded_key;
+  job->input = plain_text;
+  job->output = malloc(64);
+  job->len = 64;
+  job->callback = resubmit_or_free;
+  job->user_data = &state;
+
+  if (aes_async_submit(state.queue, job) != 0) passed = 0;
+  for (int i = 0; i < 500 && __atomic_load_n(&state.runs, __ATOMIC_SEQ_CST) < 3;
+       i++)
+    usleep(10000);
+  aes_async_destroy(state.queue);
+  if (state.runs != 3 || state.failed) passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+}
+
+/**
+ * Test function for spreading jobs over workers. Four large jobs are queued
+ * for four workers that could each take eight: every worker must take one
+ * rather than the first one to wake taking them all.
+ * @return void
+ */
+void test_async_spread() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  const size_t len = 256 * 1024;
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char *data = calloc(4, len);
+  struct aes_job jobs[4], *done[4];
+  struct aes_async_stats stats;
+  struct aes_async *queue = aes_async_create(4, 8, 8);
+  int reaped = 0, passed = 1;
+
+  if (queue == NULL || data == NULL) {
+    printf("Test failed!\n");
+    if (queue != NULL) aes_async_destroy(queue);
+    free(data);
+    return;
+  }
+  expand_key(expanded_key, key);
+  memset(jobs, 0, sizeof(jobs));
+  for (int i = 0; i < 4; i++) {
+    jobs[i].mode = AES_JOB_ECB_ENCRYPT;
+    jobs[i].ctx = expanded_key;
+    jobs[i].input = data + i * len;
+    jobs[i].output = data + i * len;
+    jobs[i].len = len;
+    if (aes_async_submit(queue, &jobs[i]) != 0) passed = 0;
+  }
+  while (reaped < 4) {
+    int n = aes_async_wait(queue, done, 4, 5000);
+    if (n == 0) break;
+    reaped += n;
+  }
+  aes_async_get_stats(queue, &stats);
+  if (reaped != 4 || stats.completed != 4 || stats.batches != 4) passed = 0;
+  for (int i = 0; i < 4; i++) {
+    if (jobs[i].status != AES_JOB_OK) passed = 0;
+  }
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  aes_async_destroy(queue);
+  free(data);
+}
+
+/**
+ * @brief One client of test_aesd_concurrent, run on its own thread.
+ */
+struct aesd_test_client {
+  struct aesd_conn *conn;
+  int key_id;
+  size_t offset;
+  size_t len;
+  int status;
+};
+
+/**
+ * Thread body for test_aesd_concurrent: one synchronous encryption.
+ */
+static void *aesd_test_encrypt(void *arg) {
+  struct aesd_test_client *client = (struct aesd_test_client *)arg;
+  client->status = aesd_encrypt_blocks(client->conn, client->key_id,
+                                       client->offset, client->len);
+  return NULL;
+}
+
+/**
+ * Test function for batching across clients. The daemon is stopped while
+ * four clients on their own threads send requests, so when it resumes they
+ * all arrive in one batch: three clients share a key and one has its own,
+ * and the lengths mix requests that are gathered into the staging buffer
+ * with ones run in place. Every result must match the in-process engine, and
+ * the daemon's own count must show batches of several requests.
+ * @return void
+ */
+void test_aesd_concurrent() {
+  static const size_t lens[4] = {16, 272, 4096, 4112};
+  const int nbr_rounds = 5;
+  unsigned char keys[2][16] = {{50, 20, 46, 86, 67, 9, 70, 27,
+                                75, 17, 51, 17, 4,  8, 6,  99},
+                               {1, 2, 3, 4, 5, 6, 7, 8,
+                                9, 10, 11, 12, 13, 14, 15, 16}};
+  unsigned char expanded_keys[2][EXPANDED_KEY_SIZE];
+  unsigned char *plain_text = malloc(8192), *expected = malloc(8192);
+  struct aesd_test_client clients[4];
+  pthread_t threads[4];
+  unsigned long long requests = 0, batches = 0;
+  FILE *log = tmpfile();
+  char path[64];
+  int passed = 1;
+  pid_t pid;
+
+  snprintf(path, sizeof(path), "/tmp/aesd-test-%d.sock", (int)getpid());
+  pid = start_aesd(path, fileno(log));
+  memset(clients, 0, sizeof(clients));
+  for (int i = 0; i < 100 && clients[0].conn == NULL; i++) {
+    clients[0].conn = aesd_connect(path, 8192);
+    if (clients[0].conn == NULL) usleep(20000);
+  }
+  for (int t = 1; t < 4; t++) clients[t].conn = aesd_connect(path, 8192);
+  for (int t = 0; t < 4; t++) {
+    if (clients[t].conn == NULL) passed = 0;
+  }
+  if (!passed) {
+    printf("Test failed!\n");
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  for (int i = 0; i < 8192; i++) plain_text[i] = (i * 5) & 0xff;
+  for (int k = 0; k < 2; k++) expand_key(expanded_keys[k], keys[k]);
+  for (int t = 0; t < 4; t++) {
+    clients[t].key_id = aesd_register_key(clients[t].conn, keys[t == 3]);
+    clients[t].offset = (size_t)t * 16;
+    clients[t].len = lens[t];
+    if (clients[t].key_id < 0) passed = 0;
+  }
+
+  for (int round = 0; round < nbr_rounds; round++) {
+    for (int t = 0; t < 4; t++)
+      memcpy(aesd_buffer(clients[t].conn), plain_text, 8192);
+    kill(pid, SIGSTOP);
+    for (int t = 0; t < 4; t++)
+      pthread_create(&threads[t], NULL, aesd_test_encrypt, &clients[t]);
+    usleep(100000);  // let every client send before the daemon resumes
+    kill(pid, SIGCONT);
+    for (int t = 0; t < 4; t++) {
+      pthread_join(threads[t], NULL);
+      memcpy(expected, plain_text, 8192);
+      aes_encrypt_blocks(expected + clients[t].offset,
+                         expected + clients[t].offset,
+                         clients[t].len / BLOCK_SIZE, expanded_keys[t == 3]);
+      if (clients[t].status != AESD_OK ||
+          memcmp(aesd_buffer(clients[t].conn), expected, 8192) != 0)
+        passed = 0;
+    }
+  }
+
+  for (int t = 0; t < 4; t++) aesd_close(clients[t].conn);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  rewind(log);
+  if (fscanf(log, "aesd: %llu requests in %llu batches", &requests,
+             &batches) != 2 ||
+      requests != 4 + 4 * (unsigned long long)nbr_rounds ||
+      batches > requests / 2)
+    passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  fclose(log);
+  free(plain_text);
+  free(expected);
+}
+
+/**
+ * Test function for requests that one client pipelines over the same shared
+ * memory. The daemon is stopped while they are sent, so they arrive in one
+ * round, and each must still see the result of the ones before it: two
+ * encryptions of a block give E(E(p)), and a decryption undoes the
+ * encryption sent just before it.
+ * @return void
+ */
+void test_aesd_pipelined() {
+  static const struct {
+    unsigned int op;
+    size_t offset, len;
+  } ops[5] = {{AESD_OP_REGISTER_KEY, 0, 0},
+              {AESD_OP_ENCRYPT_BLOCKS, 0, 32},
+              {AESD_OP_ENCRYPT_BLOCKS, 16, 32},
+              {AESD_OP_DECRYPT_BLOCKS, 32, 16},
+              {AESD_OP_ENCRYPT_BLOCKS, 0, 16}};
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  unsigned char expanded_key[EXPANDED_KEY_SIZE];
+  unsigned char expected[48];
+  unsigned char *shm = MAP_FAILED;
+  struct aesd_request requests[5];
+  struct aesd_response responses[5];
+  char path[64];
+  int shm_fd = memfd_create("pipelined", MFD_ALLOW_SEALING);
+  int fd = -1, passed = 1;
+  pid_t pid;
+
+  snprintf(path, sizeof(path), "/tmp/aesd-test-%d.sock", (int)getpid());
+  pid = start_aesd(path, -1);
+  if (shm_fd >= 0 && ftruncate(shm_fd, 4096) == 0 &&
+      fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == 0)
+    shm = (unsigned char *)mmap(NULL, 4096, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, shm_fd, 0);
+  for (int i = 0; i < 100 && shm != MAP_FAILED && fd < 0; i++) {
+    fd = raw_aesd_connect(path, shm_fd, 4096);
+    if (fd < 0) usleep(20000);
+  }
+  if (fd < 0) {
+    printf("Test failed!\n");
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  for (int i = 0; i < 48; i++) shm[i] = expected[i] = (i * 7) & 0xff;
+  expand_key(expanded_key, key);
+  aes_encrypt_blocks(expected, expected, 2, expanded_key);
+  aes_encrypt_blocks(expected, expected, 2, expanded_key);
+
+  memset(requests, 0, sizeof(requests));
+  for (int i = 0; i < 5; i++) {
+    requests[i].op = ops[i].op;
+    requests[i].id = (unsigned long long)i;
+    requests[i].offset = ops[i].offset;
+    requests[i].len = ops[i].len;
+  }
+  memcpy(requests[0].key, key, sizeof(key));
+  kill(pid, SIGSTOP);
+  if (send(fd, requests, sizeof(requests), MSG_NOSIGNAL) !=
+      (ssize_t)sizeof(requests))
+    passed = 0;
+  kill(pid, SIGCONT);
+  if (recv(fd, responses, sizeof(responses), MSG_WAITALL) !=
+      (ssize_t)sizeof(responses))
+    passed = 0;
+  for (int i = 0; passed && i < 5; i++) {
+    if (responses[i].id != (unsigned long long)i || responses[i].status != 0)
+      passed = 0;
+  }
+  if (memcmp(shm, expected, 48) != 0) passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  close(fd);
+  munmap(shm, 4096);
+  close(shm_fd);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+/**
+ * Test function for the client's check of who it connected to. A child
+ * process listens on the socket path as another user, as a local attacker
+ * who bound the path first would, and aesd_connect must refuse to talk to
+ * it. Without root there is no other user to run as; the child then keeps
+ * this user and the connection must be accepted instead.
+ * @return void
+ */
+void test_aesd_untrusted_peer() {
+  struct sockaddr_un addr;
+  struct aesd_conn *conn;
+  char path[64];
+  int ready[2], as_root = geteuid() == 0, passed = 1;
+  char byte = 0;
+  pid_t pid;
+
+  snprintf(path, sizeof(path), "/tmp/aesd-test-%d.sock", (int)getpid());
+  if (pipe(ready) != 0) {
+    printf("Test failed!\n");
+    return;
+  }
+  pid = fork();
+  if (pid == 0) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(path, 0777) != 0 || (as_root && setuid(65534) != 0) ||
+        listen(fd, 1) != 0)
+      _exit(1);
+    if (write(ready[1], &byte, 1) != 1) _exit(1);
+    pause();
+    _exit(0);
+  }
+  close(ready[1]);
+  if (pid < 0 || read(ready[0], &byte, 1) != 1) passed = 0;
+  close(ready[0]);
+
+  conn = passed ? aesd_connect(path, 64) : NULL;
+  if ((conn != NULL) == as_root) passed = 0;
+  if (conn != NULL) aesd_close(conn);
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+  unlink(path);
+}
+
+/**
+ * Test function for a client that stops reading its responses. It floods the
+ * daemon with requests until the daemon stops taking them, which shows its
+ * responses have backed up. Another client must still be served at once
+ * rather than waiting behind the stalled one.
+ * @return void
+ */
+void test_aesd_slow_reader() {
+  unsigned char key[16] = {50, 20, 46, 86, 67, 9, 70, 27,
+                           75, 17, 51, 17, 4,  8, 6,  99};
+  struct aesd_request request;
+  struct aesd_conn *conn = NULL;
+  struct pollfd pfd;
+  struct timespec start, end;
+  char path[64];
+  int shm_fd = memfd_create("slow", MFD_ALLOW_SEALING);
+  int fd = -1, key_id, passed = 1;
+  double elapsed;
+  pid_t pid;
+
+  snprintf(path, sizeof(path), "/tmp/aesd-test-%d.sock", (int)getpid());
+  pid = start_aesd(path, -1);
+  for (int i = 0; i < 100 && conn == NULL; i++) {
+    conn = aesd_connect(path, 64);
+    if (conn == NULL) usleep(20000);
+  }
+  if (conn == NULL || shm_fd < 0 || ftruncate(shm_fd, 4096) != 0 ||
+      fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0 ||
+      (fd = raw_aesd_connect(path, shm_fd, 4096)) < 0 ||
+      (key_id = aesd_register_key(conn, key)) < 0) {
+    printf("Test failed!\n");
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  // Register a key, then send encryptions until the socket stays full for
+  // 200 ms: by then the daemon has stopped reading this client.
+  memset(&request, 0, sizeof(request));
+  request.op = AESD_OP_REGISTER_KEY;
+  send(fd, &request, sizeof(request), MSG_NOSIGNAL);
+  request.op = AESD_OP_ENCRYPT_BLOCKS;
+  request.len = BLOCK_SIZE;
+  pfd.fd = fd;
+  pfd.events = POLLOUT;
+  for (;;) {
+    ssize_t n =
+        send(fd, &request, sizeof(request), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == (ssize_t)sizeof(request)) {
+      request.id++;
+      continue;
+    }
+    if (n >= 0 || errno != EAGAIN || poll(&pfd, 1, 200) == 0) break;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (aesd_encrypt_blocks(conn, key_id, 0, 64) != AESD_OK) passed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  if (elapsed > 0.3 || waitpid(pid, NULL, WNOHANG) != 0) passed = 0;
+
+  printf(passed ? "Test passed!\n" : "Test failed!\n");
+  close(fd);
+  close(shm_fd);
+  aesd_close(conn);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
 /**
  * @brief Entry point of the program.
  *
@@ -102,5 +1473,26 @@ void test_aes_decrypt_block() {
 int main() {
   test_aes_decrypt_block();
   test_aes_encrypt_block();
+  test_aes_encrypt_blocks();
+  test_aes_block_otf();
+  test_ocb_rfc7253();
+  test_ocb_multi_thread();
+  test_aes_hash_avalanche();
+  test_aes_hash_vectors();
+  test_aes_hash_collisions();
+  test_aes_hash_differential();
+  test_container();
+  test_aesd();
+  test_aesd_concurrent();
+  test_aesd_pipelined();
+  test_aesd_untrusted_peer();
+  test_aesd_slow_reader();
+  test_ctr_sp800_38a();
+  test_cmac_rfc4493();
+  test_gcm_vectors();
+  test_stream_iov();
+  test_async();
+  test_async_callback_ownership();
+  test_async_spread();
   return 0;
 }
\ No newline at end of file